@@ -0,0 +1,165 @@
+/**
+ * @file bench_http.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ * @brief A keep-alive HTTP load generator.
+ *
+ * @details
+ * Usage: ./bench_http <port> <uri> [connections] [seconds]
+ *
+ * Every connection sends one GET request at a time on a keep-alive connection,
+ * reads the whole response according to Content-length and sends the next one.
+ * The number of completed requests per second is printed at the end.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#define BENCH_BUFFER_SIZE 65536
+
+struct bench_conn {
+  int sockfd;
+  char buf[BENCH_BUFFER_SIZE];
+  size_t length;      // Bytes in buf
+  long expected;      // Total length of the current response, -1 if headers are incomplete
+  long received;      // Bytes of the current response received
+};
+
+static char request[512];
+static size_t request_length;
+static long completed = 0;
+static long failed = 0;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int bench_connect(int port) {
+  int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror("connect()");
+    exit(-1);
+  }
+  fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL, 0) | O_NONBLOCK);
+  return sockfd;
+}
+
+static void bench_send(struct bench_conn *conn) {
+  conn->length = 0;
+  conn->expected = -1;
+  conn->received = 0;
+  if (send(conn->sockfd, request, request_length, 0) != (ssize_t)request_length) {
+    failed++;
+  }
+}
+
+/**
+ * @return 1 if the response is complete.
+ */
+static int bench_recv(struct bench_conn *conn) {
+  while (1) {
+    char *buf = conn->expected < 0 ? conn->buf + conn->length : conn->buf;
+    size_t room = conn->expected < 0 ? BENCH_BUFFER_SIZE - 1 - conn->length : BENCH_BUFFER_SIZE;
+    ssize_t bytes_read = recv(conn->sockfd, buf, room, 0);
+    if (bytes_read <= 0) {
+      if (bytes_read < 0 && errno == EAGAIN) {
+        return 0;
+      }
+      failed++;
+      return -1;
+    }
+    conn->received += bytes_read;
+    if (conn->expected < 0) {
+      conn->length += bytes_read;
+      conn->buf[conn->length] = '\0';
+      char *end = strstr(conn->buf, "\r\n\r\n");
+      if (end) {
+        char *field = strcasestr(conn->buf, "Content-length:");
+        long body = field ? atol(field + 15) : 0;
+        conn->expected = (end + 4 - conn->buf) + body;
+      }
+    }
+    if (conn->expected >= 0 && conn->received >= conn->expected) {
+      return 1;
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fputs("Usage: ./bench_http <port> <uri> [connections] [seconds]\n", stderr);
+    exit(-1);
+  }
+  int port = atoi(argv[1]);
+  int num_of_conns = argc > 3 ? atoi(argv[3]) : 64;
+  double seconds = argc > 4 ? atof(argv[4]) : 10;
+  request_length = snprintf(request, sizeof(request),
+                            "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: Keep-Alive\r\n\r\n", argv[2]);
+
+  int epollfd = epoll_create1(0);
+  struct bench_conn *conns = (struct bench_conn*)calloc(num_of_conns, sizeof(struct bench_conn));
+  for (int i = 0; i < num_of_conns; i++) {
+    conns[i].sockfd = bench_connect(port);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &conns[i];
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, conns[i].sockfd, &ev);
+    bench_send(&conns[i]);
+  }
+
+  struct epoll_event events[1024];
+  double start = now();
+  while (now() - start < seconds) {
+    int nready = epoll_wait(epollfd, events, 1024, 100);
+    for (int i = 0; i < nready; i++) {
+      struct bench_conn *conn = (struct bench_conn*)events[i].data.ptr;
+      int result = bench_recv(conn);
+      if (result > 0) {
+        completed++;
+        bench_send(conn);
+      } else if (result < 0) {
+        epoll_ctl(epollfd, EPOLL_CTL_DEL, conn->sockfd, NULL);
+        close(conn->sockfd);
+        conn->sockfd = bench_connect(port);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        epoll_ctl(epollfd, EPOLL_CTL_ADD, conn->sockfd, &ev);
+        bench_send(conn);
+      }
+    }
+  }
+  double elapsed = now() - start;
+
+  printf("connections: %d\n", num_of_conns);
+  printf("requests:    %ld\n", completed);
+  printf("failed:      %ld\n", failed);
+  printf("requests/s:  %.0f\n", completed / elapsed);
+
+  for (int i = 0; i < num_of_conns; i++) {
+    close(conns[i].sockfd);
+  }
+  free(conns);
+  close(epollfd);
+  return 0;
+}
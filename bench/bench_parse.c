@@ -0,0 +1,108 @@
+/**
+ * @file bench_parse.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ * @brief Compare the throughput of hsrequest_parse() and the bison parser behind parse_yacc().
+ *
+ * @details
+ * Usage: ./bench_parse [seconds]
+ *
+ * Every parser parses the same requests repeatedly for the given time (1 second by default),
+ * and the parsed bytes per second are printed in MB/s.
+ * hsrequest_parse() is measured with every scanning kernel supported by the CPU.
+ */
+
+#include "request.h"
+#include "parse.h"
+#include "scan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *samples[] = {
+  "GET /index.html HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: Keep-Alive\r\n\r\n",
+
+  "GET /images/liso_header.png HTTP/1.1\r\n"
+  "Host: www.example.com\r\n"
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+  "Accept-Language: en-US,en;q=0.9\r\n"
+  "Accept-Encoding: gzip, deflate, br\r\n"
+  "Referer: http://www.example.com/index.html\r\n"
+  "Cookie: session=7f3a9c2e4b1d8f6a0e5c3b7d9a1f4e2c; theme=dark; lang=en; tracking=a1b2c3d4e5f6a7b8c9d0e1f2a3b4c5d6\r\n"
+  "Connection: Keep-Alive\r\n\r\n",
+
+  "GET /search?q=ring+buffer&page=2 HTTP/1.1\r\n"
+  "Host: www.example.com\r\n"
+  "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:121.0) Gecko/20100101 Firefox/121.0\r\n"
+  "Accept: */*\r\n"
+  "Cookie: _ga=GA1.2.1234567890.1700000000; _gid=GA1.2.987654321.1700000000; "
+  "session=eyJhbGciOiJIUzI1NiIsInR5cCI6IkpXVCJ9.eyJzdWIiOiIxMjM0NTY3ODkwIiwibmFtZSI6IkpvaG4gRG9lIiwiaWF0IjoxNTE2MjM5MDIyfQ."
+  "SflKxwRJSMeKKF2QT4fwpMeJf36POk6yJV_adQssw5c; preferences=eyJ0aGVtZSI6ImRhcmsiLCJsYW5nIjoiZW4iLCJ0eiI6IlVUQyJ9; "
+  "csrftoken=4f8a1d2c3b6e9f0a7d5c8b1e2f3a4d6c9b8e7f0a1d2c3b4e5f6a7b8c9d0e1f2a\r\n"
+  "Connection: Keep-Alive\r\n\r\n",
+};
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int parse_hsrequest(char *buffer, size_t size) {
+  struct hsrequest request;
+  return hsrequest_parse(&request, NULL, buffer, size);
+}
+
+static int parse_bison(char *buffer, size_t size) {
+  Request *request;
+  int length = (int)size;
+  int result = parse_yacc(buffer, &length, &request);
+  parse_free(request);
+  return result;
+}
+
+/**
+ * @return Parsed megabytes per second.
+ */
+static double run(int (*parser)(char*, size_t), char *buffer, size_t size, double seconds) {
+  long iterations = 0;
+  double start = now();
+  double elapsed;
+  do {
+    for (int i = 0; i < 1000; i++) {
+      if (parser(buffer, size) != HSPARSE_VALID) {
+        fputs("parse failed\n", stderr);
+        exit(-1);
+      }
+    }
+    iterations += 1000;
+  } while ((elapsed = now() - start) < seconds);
+  return iterations * size / elapsed / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+  double seconds = argc > 1 ? atof(argv[1]) : 1;
+  printf("%-8s %-10s", "bytes", "yyparse");
+  int max_level = hsscan_select(HSSCAN_AVX2);
+  for (int level = HSSCAN_SCALAR; level <= max_level; level++) {
+    hsscan_select(level);
+    printf(" %-10s", hsscan_name());
+  }
+  printf("\n");
+  for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+    size_t size = strlen(samples[i]);
+    char *buffer = strdup(samples[i]);
+    printf("%-8zu %-10.1f", size, run(parse_bison, buffer, size, seconds));
+    for (int level = HSSCAN_SCALAR; level <= max_level; level++) {
+      hsscan_select(level);
+      printf(" %-10.1f", run(parse_hsrequest, buffer, size, seconds));
+    }
+    printf("\n");
+    free(buffer);
+  }
+  return 0;
+}
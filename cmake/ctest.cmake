@@ -5,3 +5,17 @@ include(CTest)
 add_test(NAME "test_buffer" COMMAND ${PROJECT_BINARY_DIR}/tests/test_buffer)
 add_test(NAME "test_event" COMMAND ${PROJECT_BINARY_DIR}/tests/test_event)
 add_test(NAME "test_parse" COMMAND ${PROJECT_BINARY_DIR}/tests/test_parse)
+add_test(NAME "test_timer" COMMAND ${PROJECT_BINARY_DIR}/tests/test_timer)
+add_test(NAME "test_pool" COMMAND ${PROJECT_BINARY_DIR}/tests/test_pool)
+add_test(NAME "test_outq" COMMAND ${PROJECT_BINARY_DIR}/tests/test_outq)
+add_test(NAME "test_ring" COMMAND ${PROJECT_BINARY_DIR}/tests/test_ring)
+add_test(NAME "test_request" COMMAND ${PROJECT_BINARY_DIR}/tests/test_request)
+add_test(NAME "test_scan" COMMAND ${PROJECT_BINARY_DIR}/tests/test_scan)
+add_test(NAME "test_arena" COMMAND ${PROJECT_BINARY_DIR}/tests/test_arena)
+add_test(NAME "test_body" COMMAND ${PROJECT_BINARY_DIR}/tests/test_body)
+add_test(NAME "test_filecache" COMMAND ${PROJECT_BINARY_DIR}/tests/test_filecache)
+add_test(NAME "test_range" COMMAND ${PROJECT_BINARY_DIR}/tests/test_range)
+add_test(NAME "test_gzip" COMMAND ${PROJECT_BINARY_DIR}/tests/test_gzip)
+add_test(NAME "test_timeout" COMMAND ${PROJECT_BINARY_DIR}/tests/test_timeout)
+add_test(NAME "test_reuse" COMMAND ${PROJECT_BINARY_DIR}/tests/test_reuse)
+add_test(NAME "test_poller" COMMAND ${PROJECT_BINARY_DIR}/tests/test_poller)
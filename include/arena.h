@@ -0,0 +1,62 @@
+/**
+ * @file arena.h
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ *
+ * @details
+ * This file declares an arena allocator and some functions related to it.
+ *
+ * An arena hands out memory from large chunks by moving a pointer,
+ * nothing is freed on its own, and all the chunks are freed in one step.
+ * It suits objects that live and die together, like the fields of a parsed request.
+ */
+
+#ifndef HS_ARENA
+#define HS_ARENA
+
+#include <stddef.h>
+
+#define HSARENA_CHUNK 4096   // Default size of a chunk
+
+struct hsarena_chunk;
+
+/**
+ * @note
+ * The arena is not thread-safe.
+ */
+struct hsarena {
+  struct hsarena_chunk *chunk;   // The current chunk, linked to the previous ones
+  char *pos;                     // Next free byte of the current chunk
+  char *end;                     // End of the current chunk
+  size_t next_size;              // Size of the next chunk
+};
+
+/**
+ * @brief Initialize an empty arena, no memory is allocated until the first hsarena_alloc().
+ *
+ * @param[in] first_size The size of the first chunk, e.g. the expected size of all the allocations,
+ * or 0 for HSARENA_CHUNK.
+ */
+void hsarena_init(struct hsarena *arena, size_t first_size);
+
+/**
+ * @brief Allocate size bytes aligned for any type.
+ *
+ * @return A pointer to the memory, or NULL if malloc() failed.
+ */
+void* hsarena_alloc(struct hsarena *arena, size_t size);
+
+/**
+ * @brief Copy length bytes of str to the arena and null-terminate them.
+ *
+ * @return A pointer to the copy, or NULL if malloc() failed.
+ */
+char* hsarena_strndup(struct hsarena *arena, const char *str, size_t length);
+
+/**
+ * @brief Free all the memory of the arena, it can be used again afterwards.
+ */
+void hsarena_free(struct hsarena *arena);
+
+#endif  // HS_ARENA
@@ -0,0 +1,72 @@
+/**
+ * @file body.h
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ *
+ * @details
+ * This file declares a streaming reader of request bodies.
+ *
+ * Every connection keeps one hsbody. The body of a request is framed by Content-Length
+ * or by Transfer-Encoding: chunked, and its bytes are decoded as they arrive
+ * and handed to a sink, so a large upload is never held in the input buffer as a whole.
+ */
+
+#ifndef HS_BODY
+#define HS_BODY
+
+#include "request.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * @brief Receive the decoded bytes of a body.
+ *
+ * @details
+ * The sink is called with size 0 once the body has ended, or once it turned out to be malformed.
+ */
+typedef void (*hsbody_sink)(void *ctx, const char *data, size_t size);
+
+struct hsbody {
+  int state;                 // HSBODY_* state in body.c
+  uint64_t remaining;        // Bytes left of the body or of the current chunk
+  uint64_t chunk_size;       // Size of the chunk being read
+  uint64_t received;         // Bytes handed to the sink
+  hsbody_sink sink;          // NULL means the body is discarded
+  void *ctx;                 // Passed to sink
+};
+
+/**
+ * @brief Initialize a reader that is not reading any body.
+ */
+void hsbody_init(struct hsbody *body);
+
+/**
+ * @brief Start reading the body of request.
+ *
+ * @details
+ * The sink is reset, the handler of the request can set body->sink and body->ctx afterwards.
+ *
+ * @return 0 on success, or -1 if the framing of the body is invalid, e.g. a malformed Content-Length,
+ * a transfer coding other than chunked, or both Content-Length and Transfer-Encoding.
+ */
+int hsbody_start(struct hsbody *body, const struct hsrequest *request);
+
+/**
+ * @brief Decode the bytes of the body in data.
+ *
+ * @details
+ * The bytes after the end of the body belong to the next request and are not consumed.
+ *
+ * @return The number of bytes consumed, or -1 if the body is malformed.
+ */
+ssize_t hsbody_feed(struct hsbody *body, const char *data, size_t size);
+
+/**
+ * @brief Return 1 if the whole body has been read (or there is none), otherwise 0.
+ */
+int hsbody_done(const struct hsbody *body);
+
+#endif  // HS_BODY
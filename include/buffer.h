@@ -11,6 +11,8 @@
 #ifndef HS_BUFFER
 #define HS_BUFFER
 
+#include "pool.h"
+
 #include <stddef.h>
 #include <sys/types.h>
 #include <stdint.h>
@@ -46,6 +48,40 @@ struct hsbuffer;
  */
 struct hsbuffer* hsbuffer_init(uint32_t buffer_size);
 
+/**
+ * @brief Allocate and initialize an hsbuffer from a pool.
+ * 
+ * @details
+ * Both the hsbuffer and its data come from the pool and go back to it when the hsbuffer is freed. 
+ * The capacity is rounded to the size class of the pool, 
+ * so it can be a little smaller or larger than buffer_size.
+ * 
+ * The data is not allocated until the hsbuffer is first written, 
+ * and can be returned to the pool by hsbuffer_release() once the hsbuffer is empty.
+ * 
+ * @param[in] pool A pointer to the pool, NULL is the same as hsbuffer_init().
+ * @param[in] buffer_size The initial capacity of struct hsbuffer.
+ * 
+ * @return A pointer to the allocated hsbuffer, or NULL if the request failed.
+ */
+struct hsbuffer* hsbuffer_init_pool(struct hspool *pool, uint32_t buffer_size);
+
+/**
+ * @brief Allocate and initialize a ring hsbuffer.
+ * 
+ * @details
+ * The data is a memfd region mapped twice back to back, 
+ * so the readable and the writable bytes are always contiguous in memory although the hsbuffer wraps around. 
+ * Consumed bytes can be written again at once, 
+ * pipelined requests never force the hsbuffer to grow or to move its data. 
+ * The capacity is rounded up to a multiple of the page size, minus the null terminator.
+ * 
+ * @param[in] buffer_size The minimum capacity of struct hsbuffer.
+ * 
+ * @return A pointer to the allocated hsbuffer, or NULL if the request failed.
+ */
+struct hsbuffer* hsbuffer_init_ring(uint32_t buffer_size);
+
 /**
  * @brief Free the hsbuffer pointed to by ptr.
  * 
@@ -53,13 +89,33 @@ struct hsbuffer* hsbuffer_init(uint32_t buffer_size);
  */
 void hsbuffer_free(struct hsbuffer *ptr);
 
+/**
+ * @brief Return the data of an empty hsbuffer pointed by ptr to its pool.
+ * 
+ * @details
+ * If the hsbuffer still has readable bytes, no operation is performed. 
+ * The capacity is restored to the initial one, and the data is allocated again on next use. 
+ * Idle keep-alive connections release their hsbuffers so that they only cost the control structs.
+ * 
+ * @param[in] ptr A pointer to the allocated hsbuffer.
+ */
+void hsbuffer_release(struct hsbuffer *ptr);
+
+/**
+ * @brief Return 1 if the data of the hsbuffer pointed by ptr is allocated, otherwise 0.
+ */
+int hsbuffer_allocated(const struct hsbuffer *ptr);
+
 /**
  * @brief Return the readable or writable position of the hsbuffer pointed by ptr.
  * 
+ * @details
+ * The data of a lazy hsbuffer is allocated here.
+ * 
  * @param[in] ptr A pointer to the allocated hsbuffer.
  * @param[in] pos_type The type of hsbuffer position, READ_POS or WRITE_POS.
  * 
- * @return A pointer to readable or writeable position, or NULL if pos_type is invalid.
+ * @return A pointer to readable or writeable position, or NULL if pos_type is invalid or out of memory.
  */
 char* hsbuffer_pos(struct hsbuffer *ptr, int pos_type);
 
@@ -110,6 +166,17 @@ size_t hsbuffer_readable(const struct hsbuffer *ptr);
  */
 ssize_t hsbuffer_recv(int sockfd, struct hsbuffer *ptr, size_t length);
 
+/**
+ * @brief Make length bytes written at the writable position of the hsbuffer pointed by ptr readable.
+ * 
+ * @note
+ * It is the caller's responsibility to check for out-of-bounds.
+ * 
+ * @param[in] ptr A pointed to the allocated hsbuffer.
+ * @param[in] length The number of bytes written, e.g. copied by the poller.
+ */
+void hsbuffer_fill(struct hsbuffer *ptr, size_t length);
+
 /**
  * @brief Send length bytes from the hsbuffer pointed by ptr to the sockfd.
  * 
@@ -133,6 +200,16 @@ ssize_t hsbuffer_send(int sockfd, struct hsbuffer *ptr, size_t length);
  */
 void hsbuffer_expand(struct hsbuffer *ptr, size_t new_capacity);
 
+/**
+ * @brief Move the readable bytes of the hsbuffer pointed by ptr to the beginning of its data.
+ * 
+ * @details
+ * The space of the consumed bytes can be written again, a ring hsbuffer needs no compaction.
+ * 
+ * @param[in] ptr A pointer to the allocated hsbuffer.
+ */
+void hsbuffer_compact(struct hsbuffer *ptr);
+
 /**
  * @brief Copy a string.
  * 
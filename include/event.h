@@ -12,10 +12,15 @@
 #ifndef HS_EVENT
 #define HS_EVENT
 
+#include "body.h"
 #include "buffer.h"
+#include "filecache.h"
+#include "outq.h"
+#include "request.h"
+#include "timer.h"
+#include "poller.h"
 
 #include <netinet/in.h>
-#include <sys/timerfd.h>
 #include <sys/epoll.h>
 #include <string.h>
 #include <stdlib.h>
@@ -24,10 +29,15 @@
 #define HSEVENT_WRITE 1 // EPOLLOUT
 #define HSEVENT_RDHUP 2 // EPOLLRDHUP
 #define HSEVENT_ERR   3 // EPOLLERR
+#define HSEVENT_TIMEOUT 4 // Timer of the timing wheel
 
 #define HSINTERVAL    30 // Default timeout(seconds)
 
-#define MAXFD 1024
+#define HSEVENT_BATCH 1024 // Maximum number of events returned by one epoll_wait()
+#define HSEVENT_BUDGET 65536 // Maximum bytes a callback should handle in one dispatch
+#define HSEVENT_SEND_BUDGET (4 * HSEVENT_BUDGET) // Maximum bytes a connection sends in one dispatch
+#define HSEVENT_INBOUND_MAX 65536 // Inbound never grows beyond the longest request headers
+#define HSEVENT_SLOTS 1024 // Initial number of slots in hsevent_base
 
 /**
  * @brief The polling unit in the event loop.
@@ -46,11 +56,25 @@
 struct hsevent;
 
 typedef void (*hsevent_cb)(struct hsevent *event);
+
+/**
+ * @brief Intrusive doubly linked list node.
+ */
+struct hsevent_link {
+  struct hsevent_link *prev;
+  struct hsevent_link *next;
+};
+
 struct hsevent {
   int sockfd;                       // Associated socket
-  int timerfd;                      // Timer
+  struct hstimer timer;             // Timer in the timing wheel of event_base
   int pipe_rfd;                     // Read end of pipe
+  int pipe_wfd;                     // Write end of the pipe to the stdin of CGI
+  char *pipe_pending;               // Body bytes the CGI script has not read yet, malloc()
+  size_t pipe_length;               // Length of pipe_pending
+  int pipe_eof;                     // The body has ended, pipe_wfd is closed once pipe_pending is written
   struct sockaddr_in *remote;       // Client's IP address
+  struct hspool *pool;              // The pool that the hsevent comes from, NULL means malloc()
   struct hsbuffer *inbound;         // Input buffer, read data from socket
   struct hsbuffer *outbound;        // Output buffer, write data to socket
   uint32_t events;                  // Types of events monitored
@@ -59,7 +83,14 @@ struct hsevent {
   hsevent_cb write_cb;              // Callback function for EPOLLOUT
   hsevent_cb rdhup_cb;              // Callback function for EPOLLHUP
   hsevent_cb err_cb;                // Callback function for EPOLLERR
+  hsevent_cb timeout_cb;            // Callback function for timeout
+  struct hsevent_link pending_link; // Node in the pending list of event_base
+  uint32_t pending;                 // Events to be dispatched again without polling
   int closed;                       // Indicate whether to close the connection after sending the response
+  int unread;                       // Input may be left in the socket, read once the output is drained
+  struct hsoutq *outq;              // Output chain, sends outbound and the response bodies
+  struct hsparser parser;           // Parsing progress of the request at the front of inbound
+  struct hsbody body;               // Reading progress of the body of the last request
 };
 
 /**
@@ -76,10 +107,17 @@ struct hsevent {
  * and the caller should be responsible for checking whether this pointer is legal.
  */
 struct hsevent_base {
-  int epollfd;
-  struct epoll_event activate_events[MAXFD];
-  struct hsevent *sockets[MAXFD];
+  struct hspoller *poller;               // epoll or io_uring, selected at build time
+  struct epoll_event *activate_events;  // Events returned by epoll_wait(), HSEVENT_BATCH at most
+  struct hsevent **sockets;             // Slot table indexed by fd, grows on demand
+  uint32_t *generations;                // Increased whenever a slot changes, tags the registrations of fd
+  int num_of_slots;                     // Capacity of the slot table
   int num_of_events;
+  struct hspool *pool;                  // Recycles connection objects and buffer blocks
+  struct hsfcache *files;               // Open fds and stat metadata of the static files
+  struct hstimer_wheel timers;          // Timers of all hsevents, drive the timeout of epoll_wait()
+  struct hsevent_link pending;          // hsevents that have unfinished work, see hsevent_activate()
+  uint64_t now;                         // Time(milliseconds) when epoll_wait() returned
   int exit; // For debug
 };
 
@@ -87,7 +125,9 @@ struct hsevent_base {
  * @brief Initialize a hsevent.
  * 
  * @details
- * If events is zero, event_base will be ignored.
+ * If events is zero, event_base will not poll the hsevent. 
+ * If event_base is not NULL, the hsevent and its buffers are allocated from the pool of event_base,
+ * and the data of the buffers is only allocated when it is first used.
  * 
  * @param[in] sockfd The monitored listening socket or connected socket.
  * @param[in] events The events of interest to the caller.
@@ -121,6 +161,53 @@ void hsevent_update(struct hsevent *event, int events);
  */
 void hsevent_update_cb(struct hsevent *event, int event_type, hsevent_cb event_cb);
 
+/**
+ * @brief Dispatch events of a hsevent again in the next loop iteration.
+ * 
+ * @details
+ * A callback that stops after HSEVENT_BUDGET bytes has not consumed the readiness, 
+ * and an edge-triggered hsevent will not be reported again, 
+ * so the callback should call this function to resume its work later 
+ * without starving other hsevents.
+ * 
+ * @param[in] event A pointer to the allocated hsevent.
+ * @param[in] events The events to be dispatched, e.g. EPOLLIN.
+ */
+void hsevent_activate(struct hsevent *event, uint32_t events);
+
+/**
+ * @brief Arm or re-arm the timer of a hsevent.
+ * 
+ * @details
+ * When the timer expires, the timeout callback of event will be called.
+ * 
+ * @param[in] event A pointer to the allocated hsevent.
+ * @param[in] seconds The timeout, zero means disarm the timer.
+ */
+void hsevent_update_timer(struct hsevent *event, int seconds);
+
+/**
+ * @brief Accept a connection on the listening socket of a hsevent, through the poller of its hsevent_base.
+ * 
+ * @param[in] event A pointer to the allocated hsevent.
+ * @param[out] addr The address of the peer, can be NULL.
+ * @param[in,out] addrlen The size of addr.
+ * 
+ * @return The connected socket, or -1 if an error occured, errno is EAGAIN if no connection is pending.
+ */
+int hsevent_accept(struct hsevent *event, struct sockaddr *addr, socklen_t *addrlen);
+
+/**
+ * @brief Receive at most length bytes from the socket of a hsevent into its inbound hsbuffer,
+ * through the poller of its hsevent_base.
+ * 
+ * @param[in] event A pointer to the allocated hsevent.
+ * @param[in] length The maximum length of message received from the socket.
+ * 
+ * @return The number of bytes received, or -1 if an error occured.
+ */
+ssize_t hsevent_recv(struct hsevent *event, size_t length);
+
 /**
  * @brief Initialize a hsevent_base. 
  * 
@@ -146,6 +233,29 @@ void hsevent_base_update(int op,
                          struct hsevent *event,
                          struct hsevent_base *event_base);
 
+/**
+ * @brief Monitor another fd on behalf of an hsevent.
+ * 
+ * @details
+ * Readiness of fd is dispatched to the callbacks of event, 
+ * e.g. the read end of a CGI pipe is handled by the read callback of the connection.
+ * 
+ * @param[in] fd The fd to be monitored.
+ * @param[in] events The events of interest to the caller.
+ * @param[in] event The hsevent that owns fd.
+ * 
+ * @return 0 on success, or -1 if failed.
+ */
+int hsevent_base_attach(int fd, int events, struct hsevent *event);
+
+/**
+ * @brief Stop monitoring an fd attached by hsevent_base_attach(), before it is closed.
+ * 
+ * @param[in] fd The fd to be removed.
+ * @param[in] event The hsevent that owns fd.
+ */
+void hsevent_base_detach(int fd, struct hsevent *event);
+
 /**
  * @brief Clear all registered hsevent of hsevent_base.
  */
@@ -154,6 +264,12 @@ void hsevent_base_clear(struct hsevent_base *base);
 /**
  * @brief Start the event loop.
  * 
+ * @details
+ * All ready conditions of a hsevent are dispatched in one pass, in this order: 
+ * EPOLLERR (stop if err_cb is set), EPOLLIN, EPOLLOUT, EPOLLRDHUP/EPOLLHUP. 
+ * Without err_cb, EPOLLERR is dispatched to the write callback like EPOLLOUT.
+ * The dispatch stops as soon as a callback has freed the hsevent.
+ * 
  * @param[in] event_base A pointer to the allocated hsevent_base.
  */
 void hsevent_base_loop(struct hsevent_base *event_base);
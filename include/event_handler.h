@@ -24,6 +24,11 @@ void accept_conn(struct hsevent *event);
  */
 void rdhup_conn(struct hsevent *event);
 
+/**
+ * @brief Responding to the expiration of the idle timer.
+ */
+void timeout_conn(struct hsevent *event);
+
 /**
  * @brief Responding to read-ready event.
  */
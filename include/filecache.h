@@ -0,0 +1,164 @@
+/**
+ * @file filecache.h
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ *
+ * @details
+ * This file declares a cache of open files and some functions related to it.
+ *
+ * Every hsevent_base owns a cache that keeps the fds and the stat metadata
+ * of the most recently requested files, so a repeated request for a hot file
+ * does not call open(), fstat() and close() again.
+ * An entry older than the TTL is checked with one stat() before it is used,
+ * and it is reopened if the file has been replaced or modified.
+ *
+ * Small files are also kept in memory within a byte budget, together with the response headers
+ * rendered for them, so a hit is sent from memory without any file syscall.
+ * Contents released to make room are read again on the next hit.
+ * Compressed copies of files share the same budget.
+ */
+
+#ifndef HS_FILECACHE
+#define HS_FILECACHE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define HSFCACHE_FILES 256   // Default number of cached files
+#define HSFCACHE_TTL   1000  // Default milliseconds before an entry is checked again
+#define HSFCACHE_SMALL  (64 * 1024)         // Files up to this size are kept in memory
+#define HSFCACHE_BUDGET (16 * 1024 * 1024)  // Default bytes kept in memory
+
+/**
+ * @brief An open file shared by the cache and the responses that send it.
+ *
+ * @note
+ * The fields must not be modified by the users of the file.
+ */
+struct hsfile {
+  int fd;
+  struct stat st;            // fstat() of fd
+  char *path;
+  char etag[64];             // Strong entity tag with the quotes, derived from the inode, size and mtime
+  char modified[32];         // mtime as an HTTP-date, the value of Last-Modified
+  char *data;                // Contents of a small file, NULL if it is not in memory
+  char *headers;             // Response headers rendered for data, NULL until set
+  size_t headers_length;
+  struct hsfile *compressed; // Compressed copy, which only lives in memory, NULL if there is none
+  int compress_tried;        // Whether the contents have been compressed since they were last released
+  uint64_t checked;          // Time(milliseconds) when the file was opened or last checked
+  int refs;                  // References held by the cache and the users
+  int cached;                // Whether the file is still in the cache
+  unsigned missing;          // Bits of the variants that did not exist when the file was last checked
+  struct hsfile *hash_next;  // Next file in the same bucket
+  struct hsfile *lru_prev;   // Towards the most recently used file
+  struct hsfile *lru_next;   // Towards the least recently used file
+};
+
+/**
+ * @brief Statistics of a cache.
+ */
+struct hsfcache_stats {
+  uint64_t hits;             // Requests served without any syscall
+  uint64_t checks;           // Requests that called stat() because the entry was older than the TTL
+  uint64_t misses;           // Requests that opened the file
+  uint64_t memory;           // Bytes of the contents and headers kept in memory
+};
+
+/**
+ * @note
+ * The cache is not thread-safe, it belongs to one event loop.
+ */
+struct hsfcache;
+
+/**
+ * @brief Initialize a cache.
+ *
+ * @param[in] capacity The maximum number of cached files.
+ * @param[in] ttl Milliseconds before an entry is checked again, 0 means every time.
+ * @param[in] budget The maximum bytes kept in memory, 0 means no file is kept in memory.
+ *
+ * @return A pointer to the cache, or NULL if failed.
+ */
+struct hsfcache* hsfcache_init(int capacity, uint64_t ttl, size_t budget);
+
+/**
+ * @brief Free the cache, the files still referenced are closed when their last reference is dropped.
+ */
+void hsfcache_free(struct hsfcache *cache);
+
+/**
+ * @brief Open a file through the cache.
+ *
+ * @param[in] cache A pointer to the cache, NULL means the file is opened without caching.
+ * @param[in] path The path of the file.
+ * @param[in] now The current time in milliseconds.
+ *
+ * @return A reference to the file, which must be dropped by hsfile_put(),
+ * or NULL with errno set if the file can not be opened.
+ */
+struct hsfile* hsfcache_open(struct hsfcache *cache, const char *path, uint64_t now);
+
+/**
+ * @brief Open a variant of a file through the cache, e.g. index.html.gz for index.html.
+ *
+ * @details
+ * A variant that does not exist is remembered in file->missing until file is checked again,
+ * so asking for it again costs no syscall.
+ *
+ * @param[in] variant The index of the variant, less than 32.
+ * @param[in] suffix Appended to the path of file.
+ *
+ * @return A reference to the variant, or NULL if it is not a regular file.
+ */
+struct hsfile* hsfcache_open_variant(struct hsfcache *cache, struct hsfile *file, int variant, 
+                                     const char *suffix, uint64_t now);
+
+/**
+ * @brief Keep a compressed copy of a cached file in memory.
+ *
+ * @details
+ * The copy is a file without fd, whose contents are data, whose size is length,
+ * and whose entity tag is the one of file with tag appended, e.g. "...-gz".
+ * It becomes file->compressed and is dropped together with the contents of file.
+ *
+ * @param[in] data Allocated by malloc(), the cache takes the ownership.
+ * NULL records that the file does not compress, so it is not tried again.
+ *
+ * @return 0 on success, or -1 if file is not cached or the copy does not fit in the budget.
+ */
+int hsfcache_set_compressed(struct hsfcache *cache, struct hsfile *file, char *data, size_t length, 
+                            const char *tag);
+
+/**
+ * @brief Keep the response headers of a file that is in memory.
+ *
+ * @details
+ * The headers are sent with data on later hits, so they must only depend on the file.
+ *
+ * @return 0 on success, or -1 if the file is not in memory, the headers do not fit in the budget,
+ * or out of memory.
+ */
+int hsfcache_set_headers(struct hsfcache *cache, struct hsfile *file, const char *headers, size_t length);
+
+/**
+ * @brief Take another reference to a file.
+ */
+static inline struct hsfile* hsfile_get(struct hsfile *file) {
+  file->refs++;
+  return file;
+}
+
+/**
+ * @brief Drop a reference to a file.
+ */
+void hsfile_put(struct hsfile *file);
+
+/**
+ * @brief Return the statistics of a cache.
+ */
+struct hsfcache_stats hsfcache_stats(const struct hsfcache *cache);
+
+#endif  // HS_FILECACHE
@@ -0,0 +1,32 @@
+/**
+ * @file gzip.h
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ * 
+ * @details 
+ * This file declares the compression of static files for the gzip content coding.
+ * 
+ * A file is compressed once, and the compressed copy is kept by the file cache
+ * next to the file, so later responses are sent from memory.
+ */
+
+#ifndef HS_GZIP
+#define HS_GZIP
+
+#include <stddef.h>
+
+#define HSGZIP_MIN   256            // Smaller files are not worth compressing
+#define HSGZIP_MAX   (1024 * 1024)  // Larger files would block the event loop for too long
+#define HSGZIP_LEVEL 6
+
+/**
+ * @brief Compress data into one gzip member.
+ * 
+ * @param[out] result Allocated by malloc() on success, and must be freed by the caller.
+ * 
+ * @return The length of result, or 0 if failed or the result would not be smaller than data.
+ */
+size_t hsgzip_compress(const char *data, size_t length, char **result);
+
+#endif  // HS_GZIP
@@ -11,7 +11,7 @@
 #ifndef HS_LOG
 #define HS_LOG
 
-#include "parse.h"
+#include "request.h"
 
 #include <netinet/in.h>
 
@@ -34,6 +34,6 @@ int hslog_init(const char *logfile);
  * @param status The status code of the HTTP response sent by the server.
  * @param length The length of the content sent by the server, excluding the response headers.
  */
-void hslog_log(struct sockaddr_in *remote, Request *request, int status, int length);
+void hslog_log(struct sockaddr_in *remote, const struct hsrequest *request, int status, int length);
 
 #endif  // HS_LOG
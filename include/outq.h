@@ -0,0 +1,149 @@
+/**
+ * @file outq.h
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ *
+ * @details
+ * This file declares an output queue and some functions related to it.
+ *
+ * A response is a chain of segments: bytes of the outbound hsbuffer, static strings,
+ * owned blocks and file ranges. hsoutq_flush() sends the leading memory segments
+ * with one sendmsg() and file ranges with sendfile(), and remembers where it stopped
+ * when the socket would block, so the next call continues from the same byte.
+ *
+ * The memory segments in front of a file range are sent with MSG_MORE, so the headers
+ * and the beginning of the file share TCP segments instead of leaving as a short packet.
+ */
+
+#ifndef HS_OUTQ
+#define HS_OUTQ
+
+#include "buffer.h"
+#include "filecache.h"
+#include "pool.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define HSOUTQ_IOV         64      // Maximum number of memory segments sent by one sendmsg()
+#define HSOUTQ_INLINE_FILE 16384   // Files up to this size are read into memory and sent with the headers
+
+#define HSOUTQ_LATENCY    0  // Nothing is held back after the last segment, the default
+#define HSOUTQ_THROUGHPUT 1  // The socket is corked while a chain of several segments is flushed
+
+/**
+ * @brief A chain of output segments of a connection.
+ *
+ * @note
+ * The queue is bound to one hsbuffer (usually event->outbound).
+ * Bytes written into the hsbuffer are sent in order with the other segments.
+ */
+struct hsoutq;
+
+/**
+ * @brief Allocate and initialize an output queue.
+ *
+ * @param[in] pool The pool that the queue and its segments come from, can be NULL.
+ * @param[in] buffer The hsbuffer whose readable bytes are sent through the queue.
+ *
+ * @return A pointer to the allocated queue, or NULL if out of memory.
+ */
+struct hsoutq* hsoutq_init(struct hspool *pool, struct hsbuffer *buffer);
+
+/**
+ * @brief Set how the queue trades latency for fewer and fuller TCP segments.
+ *
+ * @details
+ * In HSOUTQ_THROUGHPUT mode hsoutq_flush() sets TCP_CORK before it sends a chain
+ * of more than one segment and clears it before it returns, so only full segments
+ * leave until the end of the chain, e.g. between the parts of multipart/byteranges.
+ * It costs two setsockopt() per flush.
+ *
+ * @param[in] mode HSOUTQ_LATENCY or HSOUTQ_THROUGHPUT.
+ */
+void hsoutq_set_mode(struct hsoutq *queue, int mode);
+
+/**
+ * @brief Free the queue, the owned blocks and close the queued files.
+ */
+void hsoutq_free(struct hsoutq *queue);
+
+/**
+ * @brief Append the bytes written into the bound hsbuffer since the last call.
+ *
+ * @details
+ * It is called before a segment of another type is appended,
+ * so that the segment is sent after the data that is already in the hsbuffer.
+ *
+ * @return 0 on success, or -1 if out of memory.
+ */
+int hsoutq_add_buffer(struct hsoutq *queue);
+
+/**
+ * @brief Append a string that lives longer than the queue, e.g. a string literal.
+ *
+ * @return 0 on success, or -1 if out of memory.
+ */
+int hsoutq_add_static(struct hsoutq *queue, const char *data, size_t length);
+
+/**
+ * @brief Append bytes that live as long as file, e.g. its contents kept in memory by the file cache.
+ *
+ * @details
+ * The queue takes over the reference to file and drops it after the bytes are sent.
+ *
+ * @return 0 on success, or -1 if out of memory, in which case the reference is dropped.
+ */
+int hsoutq_add_shared(struct hsoutq *queue, const char *data, size_t length, struct hsfile *file);
+
+/**
+ * @brief Append a copy of length bytes pointed to by data.
+ *
+ * @return 0 on success, or -1 if out of memory.
+ */
+int hsoutq_add_copy(struct hsoutq *queue, const char *data, size_t length);
+
+/**
+ * @brief Append length bytes of fd starting at offset.
+ *
+ * @details
+ * The queue takes the ownership of fd and closes it after the range is sent.
+ * Whole files not larger than HSOUTQ_INLINE_FILE are read into an owned block,
+ * so that they leave together with the headers.
+ *
+ * @return 0 on success, or -1 if out of memory, in which case fd is closed.
+ */
+int hsoutq_add_file(struct hsoutq *queue, int fd, off_t offset, size_t length);
+
+/**
+ * @brief Same as hsoutq_add_file(), but fd is shared through the file cache.
+ *
+ * @details
+ * The queue takes over the reference to file and drops it after the range is sent.
+ * The range is sent from memory if the file cache keeps the contents of file.
+ *
+ * @return 0 on success, or -1 if out of memory, in which case the reference is dropped.
+ */
+int hsoutq_add_hsfile(struct hsoutq *queue, struct hsfile *file, off_t offset, size_t length);
+
+/**
+ * @brief Send as much of the queue as the socket accepts, up to about budget bytes.
+ *
+ * @details
+ * A file range is never sent with more than the rest of the budget in one sendfile(),
+ * so a large download can not monopolize the event loop.
+ *
+ * @param[in] budget Bytes after which the flush stops, 0 means no limit.
+ *
+ * @return 1 if the queue has been drained, 0 if the socket would block, 
+ * 2 if the budget has been used up, -1 if an error occured.
+ */
+int hsoutq_flush(struct hsoutq *queue, int sockfd, size_t budget);
+
+/**
+ * @brief Return the number of bytes in the queue that have not been sent.
+ */
+size_t hsoutq_pending(const struct hsoutq *queue);
+
+#endif  // HS_OUTQ
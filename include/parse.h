@@ -12,6 +12,8 @@
 #ifndef HSHTTP_PARSE
 #define HSHTTP_PARSE
 
+#include "arena.h"
+
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,24 +24,37 @@
 
 typedef struct
 {
-	char header_name[128];
-	char header_value[256];
+	char *header_name;         // Null-terminated, in the arena of the request
+	char *header_value;        // Null-terminated, in the arena of the request
+	size_t name_length;
+	size_t value_length;
 } Request_header;
 
+/**
+ * @brief A parsed HTTP request.
+ * 
+ * @details
+ * The request itself, the URI, the header array and every header field live in one arena, 
+ * so they are allocated without realloc() churn and are freed in one step by parse_free().
+ */
 typedef struct
 {
 	char http_version[16];
 	char http_method[16];
-	char http_uri[256];
+	char *http_uri;            // Null-terminated, in the arena of the request
 	Request_header *headers;
 	int header_count;
   int header_capacity;
+  struct hsarena arena;
 } Request;
 
 /**
  * @brief Parse HTTP request.
  * 
  * @details
+ * This function is reentrant, it is built on hsrequest_parse() and keeps no global state, 
+ * so any number of threads can parse at the same time. 
+ * 
  * There are two reasons for the failure of parsing: 
  * one is that it does not end with \r\n\r\n, we think this request is incomplete, 
  * and we should continue to read data from the socket; 
@@ -60,7 +75,16 @@ typedef struct
 int parse(char *buffer, int *size, Request **request);
 
 /**
- * @brief Find the request header of the specified key.
+ * @brief Parse HTTP request with the bison grammar in lex_yacc/.
+ * 
+ * @details
+ * Same as parse(), but the generated parser and scanner keep their state in global variables, 
+ * so it must not be called by more than one thread. It is kept as the baseline of bench_parse.
+ */
+int parse_yacc(char *buffer, int *size, Request **request);
+
+/**
+ * @brief Find the request header of the specified key, ignoring case.
  * 
  * @param[in] request A pointer to the HTTP request.
  * @param[in] key The key of the request header.
@@ -74,7 +98,16 @@ Request_header* find_key(Request *request, const char *key);
  */
 void parse_free(Request *request);
 
+/**
+ * @brief Append a header field to request, the name and the value are copied to its arena.
+ * 
+ * @return 0 on success, or -1 if the arena is out of memory.
+ */
+int request_add_header(Request *request, const char *name, size_t name_length, 
+                       const char *value, size_t value_length);
+
 int yyparse();
+void yyrestart(FILE *input_file);
 void set_parsing_options(char *buf, size_t i, Request *request);
 
 #endif  // HSHTTP_PARSE
@@ -0,0 +1,95 @@
+/**
+ * @file poller.h
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ *
+ * @details
+ * This file declares the polling backend used by hsevent_base.
+ *
+ * There are two implementations, selected at build time by the HS_IO_URING option:
+ * poller_epoll.c uses epoll, and poller_uring.c uses multishot requests of io_uring,
+ * where all registrations of one loop iteration are submitted
+ * together with the wait in a single io_uring_enter().
+ * The io_uring backend also accepts connections and receives data ahead of the callbacks,
+ * which take them with hspoller_accept() and hspoller_recv().
+ *
+ * Both of them report readiness with the EPOLL* flags,
+ * so the callbacks of struct hsevent do not depend on the backend.
+ */
+
+#ifndef HS_POLLER
+#define HS_POLLER
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+struct hspoller;
+
+/**
+ * @brief Allocate and initialize a poller.
+ *
+ * @return A pointer to the allocated poller, or NULL if failed.
+ */
+struct hspoller* hspoller_init();
+
+/**
+ * @brief Free the poller and release its kernel resources.
+ */
+void hspoller_free(struct hspoller *poller);
+
+/**
+ * @brief Add, modify or delete the events monitored on fd.
+ *
+ * @param[in] poller A pointer to the allocated poller.
+ * @param[in] op EPOLL_CTL_ADD, EPOLL_CTL_MOD or EPOLL_CTL_DEL.
+ * @param[in] fd The monitored fd.
+ * @param[in] events EPOLL* flags, EPOLLET selects edge-triggered notification.
+ * @param[in] data Reported in data.u64 of the ready events of fd, ignored by EPOLL_CTL_DEL.
+ *
+ * @return 0 on success, or -1 if failed.
+ */
+int hspoller_ctl(struct hspoller *poller, int op, int fd, uint32_t events, uint64_t data);
+
+/**
+ * @brief Wait for events.
+ *
+ * @param[in] poller A pointer to the allocated poller.
+ * @param[out] events The ready events, data.u64 is the data registered with the ready fd.
+ * @param[in] max_events The capacity of events.
+ * @param[in] timeout Milliseconds to wait, -1 means infinity.
+ *
+ * @return The number of ready events, or -1 if an error occured.
+ */
+int hspoller_wait(struct hspoller *poller, struct epoll_event *events, int max_events, int timeout);
+
+/**
+ * @brief Accept a connection on the listening fd, like accept().
+ *
+ * @details
+ * The io_uring backend returns the connections its multishot accept request has accepted,
+ * and calls accept() itself once none is left.
+ *
+ * @return The connected fd, or -1 if an error occured, errno is EAGAIN if no connection is pending.
+ */
+int hspoller_accept(struct hspoller *poller, int fd, struct sockaddr *addr, socklen_t *addrlen);
+
+/**
+ * @brief Receive at most length bytes from the connected fd, like recv().
+ *
+ * @details
+ * The io_uring backend copies the data its multishot recv request has received into a buffer ring,
+ * and calls recv() itself once none is left.
+ *
+ * @return The number of bytes received, 0 at the end of the stream, 
+ * or -1 if an error occured, errno is EAGAIN if nothing is ready.
+ */
+ssize_t hspoller_recv(struct hspoller *poller, int fd, void *buf, size_t length);
+
+/**
+ * @brief Return the name of the backend, e.g. "epoll".
+ */
+const char* hspoller_name();
+
+#endif  // HS_POLLER
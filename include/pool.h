@@ -0,0 +1,90 @@
+/**
+ * @file pool.h
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ *
+ * @details
+ * This file declares a size-classed memory pool and some functions related to it.
+ *
+ * Every hsevent_base owns a pool, connection objects (struct hsevent, struct sockaddr_in, struct hsbuffer)
+ * and the data blocks of hsbuffers are recycled through it,
+ * so accepting a connection does not call malloc() in steady state.
+ */
+
+#ifndef HS_POOL
+#define HS_POOL
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HSPOOL_MIN_SHIFT   4                 // The smallest class is 16 bytes
+#define HSPOOL_MAX_SHIFT   18                // The largest class is 256 KB
+#define HSPOOL_CLASS_BYTES (16 * 1024 * 1024) // Maximum bytes cached by one class
+
+/**
+ * @brief Statistics of a pool.
+ */
+struct hspool_stats {
+  uint64_t hits;      // Allocations served by a cached block
+  uint64_t misses;    // Allocations that called malloc()
+  uint64_t cached;    // Bytes of the cached blocks
+};
+
+/**
+ * @brief A pool of free lists, one for each power-of-two size class.
+ *
+ * @note
+ * The pool is not thread-safe, it belongs to one event loop.
+ */
+struct hspool;
+
+/**
+ * @brief Allocate and initialize a pool.
+ *
+ * @return A pointer to the allocated pool, or NULL if failed.
+ */
+struct hspool* hspool_init();
+
+/**
+ * @brief Free the pool and all cached blocks.
+ *
+ * @note
+ * Blocks that are still in use should be freed by hspool_put() before.
+ */
+void hspool_free(struct hspool *pool);
+
+/**
+ * @brief Return the size of the class that serves an allocation of size bytes.
+ *
+ * @details
+ * The caller can use the whole block, e.g. as the capacity of a buffer.
+ * Sizes larger than the largest class are returned unchanged.
+ */
+size_t hspool_class_size(size_t size);
+
+/**
+ * @brief Allocate size bytes from the pool.
+ *
+ * @details
+ * If pool is NULL, or size is larger than the largest class, malloc() is called directly.
+ *
+ * @return A pointer to the allocated block, or NULL if out of memory.
+ */
+void* hspool_alloc(struct hspool *pool, size_t size);
+
+/**
+ * @brief Return a block to the pool.
+ *
+ * @param[in] pool A pointer to the pool, or NULL if ptr was allocated without pool.
+ * @param[in] ptr A pointer returned by hspool_alloc(), can be NULL.
+ * @param[in] size The size passed to hspool_alloc().
+ */
+void hspool_put(struct hspool *pool, void *ptr, size_t size);
+
+/**
+ * @brief Return the statistics of the pool.
+ */
+struct hspool_stats hspool_stats(const struct hspool *pool);
+
+#endif  // HS_POOL
@@ -0,0 +1,43 @@
+/**
+ * @file range.h
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ * 
+ * @details 
+ * This file declares a parser of the Range header field.
+ * 
+ * Only the bytes unit is supported, e.g. "bytes=0-499", "bytes=500-", "bytes=-500"
+ * or a list of them, which is answered with multipart/byteranges.
+ */
+
+#ifndef HS_RANGE
+#define HS_RANGE
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HSRANGE_MAX 16  // A request with more ranges gets the whole file
+
+/**
+ * @brief A satisfiable range of a file, both ends are included.
+ */
+struct hsrange {
+  uint64_t first;
+  uint64_t last;
+};
+
+/**
+ * @brief Parse the value of a Range header field against a file of size bytes.
+ * 
+ * @details
+ * The unsatisfiable ranges of the list are dropped, and the ends of the others are clipped to the file.
+ * 
+ * @param[out] ranges At least max elements.
+ * 
+ * @return The number of satisfiable ranges, 0 if none of them is satisfiable, 
+ * or -1 if the field is invalid or has more than max ranges and must be ignored.
+ */
+int hsrange_parse(const char *value, size_t length, uint64_t size, struct hsrange *ranges, int max);
+
+#endif  // HS_RANGE
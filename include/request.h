@@ -0,0 +1,172 @@
+/**
+ * @file request.h
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ *
+ * @details
+ * This file declares a hand-written HTTP/1.1 request parser and the struct it fills.
+ *
+ * The parser does not copy the request. The method, URI, version and header fields
+ * are recorded as slices, i.e. offsets and lengths relative to the first byte of the request,
+ * so they point into the hsbuffer that holds it.
+ * Every byte is examined a constant number of times, there is no strlen() and no malloc().
+ * All the state lives in the hsrequest and hsparser of the caller,
+ * so any number of threads can parse concurrently.
+ */
+
+#ifndef HS_REQUEST
+#define HS_REQUEST
+
+#include "parse.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HSREQUEST_MAX_HEADERS 64   // Requests with more header fields are invalid
+
+/**
+ * @brief The header fields used by the server, recognized while parsing.
+ */
+enum hsheader_id {
+  HSHEADER_OTHER = 0,        // Any other header field
+  HSHEADER_HOST,
+  HSHEADER_CONNECTION,
+  HSHEADER_CONTENT_LENGTH,
+  HSHEADER_CONTENT_TYPE,
+  HSHEADER_TRANSFER_ENCODING,
+  HSHEADER_RANGE,
+  HSHEADER_IF_RANGE,
+  HSHEADER_IF_NONE_MATCH,
+  HSHEADER_IF_MODIFIED_SINCE,
+  HSHEADER_ACCEPT_ENCODING,
+  HSHEADER_USER_AGENT,
+  HSHEADER_ACCEPT,
+  HSHEADER_COOKIE,
+  HSHEADER_REFERER,
+  HSHEADER_COUNT
+};
+
+/**
+ * @brief A part of the request, relative to hsrequest.base.
+ */
+struct hsslice {
+  uint32_t offset;
+  uint32_t length;
+};
+
+struct hsrequest_header {
+  struct hsslice name;
+  struct hsslice value;      // Without the leading and trailing whitespace
+  int id;                    // enum hsheader_id of the name
+};
+
+/**
+ * @brief A parsed HTTP request.
+ *
+ * @note
+ * The slices are only valid while the bytes of the request are still in the buffer,
+ * so the request should be used before the buffer is written again.
+ */
+struct hsrequest {
+  const char *base;          // The first byte of the request
+  size_t length;             // Length of the request line and the header fields, including the empty line
+  struct hsslice method;
+  struct hsslice uri;
+  struct hsslice version;
+  struct hsrequest_header headers[HSREQUEST_MAX_HEADERS];
+  int header_count;
+  uint8_t known[HSHEADER_COUNT];  // 1 + the index of the first header field of every id, or 0
+};
+
+/**
+ * @brief The state kept between calls of hsrequest_parse() on the same request.
+ *
+ * @details
+ * A connection keeps one hsparser, so when the headers arrive in many small packets
+ * every byte is only searched once for the empty line.
+ */
+struct hsparser {
+  size_t scanned;            // Bytes of the request searched without finding the empty line
+};
+
+/**
+ * @brief Initialize a parser before the first byte of a request arrives.
+ */
+void hsparser_init(struct hsparser *parser);
+
+/**
+ * @brief Parse an HTTP request.
+ *
+ * @details
+ * Like parse(), the request is incomplete until the empty line (\r\n\r\n) has arrived.
+ * Then the request line and the header fields are checked against RFC 7230:
+ * the method and the field names are tokens, the URI and the version contain no whitespace or CTLs,
+ * the field values contain no CTLs other than HTAB, and every line ends with \r\n.
+ *
+ * If the request is incomplete, parser remembers how far it has been searched,
+ * and the next call with the same request and more bytes continues from there.
+ * Once the result is not HSPARSE_INCOMPLETE, parser is ready for the next request.
+ *
+ * @param[out] request The result after parsing.
+ * @param[in out] parser The state of the request, or NULL to parse from the first byte.
+ * @param[in] buffer A pointer to the first byte of the request.
+ * @param[in] size The number of bytes to be parsed.
+ *
+ * @return HSPARSE_VALID, HSPARSE_INVALID or HSPARSE_INCOMPLETE.
+ * request->length is set to the length of the request headers if the result is not HSPARSE_INCOMPLETE,
+ * so that they can be consumed from the buffer.
+ */
+int hsrequest_parse(struct hsrequest *request, struct hsparser *parser, const char *buffer, size_t size);
+
+/**
+ * @brief Return the enum hsheader_id of a header field name, ignoring case.
+ *
+ * @details
+ * The name is looked up in a perfect hash of the known names built at compile time,
+ * so at most one name is compared.
+ */
+int hsheader_id(const char *name, size_t length);
+
+/**
+ * @brief Return a pointer to the first byte of slice.
+ *
+ * @note
+ * The bytes are not null-terminated.
+ */
+static inline const char* hsrequest_ptr(const struct hsrequest *request, struct hsslice slice) {
+  return request->base + slice.offset;
+}
+
+/**
+ * @brief Return 1 if slice is equal to the null-terminated string str, otherwise 0.
+ */
+int hsslice_equal(const struct hsrequest *request, struct hsslice slice, const char *str);
+
+/**
+ * @brief Same as hsslice_equal(), but ignore case, e.g. for the tokens in header field values.
+ */
+int hsslice_equal_nocase(const struct hsrequest *request, struct hsslice slice, const char *str);
+
+/**
+ * @brief Return the first header field of a known name in O(1).
+ *
+ * @param[in] request A pointer to the request, can be NULL.
+ * @param[in] id One of enum hsheader_id except HSHEADER_OTHER.
+ *
+ * @return A pointer to the header field, or NULL if not found.
+ */
+static inline const struct hsrequest_header* hsrequest_get(const struct hsrequest *request, int id) {
+  return request && request->known[id] ? &request->headers[request->known[id] - 1] : NULL;
+}
+
+/**
+ * @brief Find the header field with the specified name, ignoring case.
+ *
+ * @param[in] request A pointer to the request, can be NULL.
+ *
+ * @return A pointer to the header field, or NULL if not found.
+ */
+const struct hsrequest_header* hsrequest_find(const struct hsrequest *request, const char *name);
+
+#endif  // HS_REQUEST
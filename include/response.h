@@ -11,10 +11,10 @@
 #ifndef HS_RESPONSE
 #define HS_RESPONSE
 
-#include "parse.h"
+#include "request.h"
 #include "event.h"
 
-extern char file_path[256];
+extern char file_path[256];  // The root of the website, never modified after startup
 extern int initial_length;
 
 extern char cgi_folder[128];
@@ -24,15 +24,18 @@ extern int cgifolder_length;
  * @brief Parse event->inbound and write the response to event->outbound.
  * 
  * @param[in] event The target of parsing and generating response.
- * @param[out] fd The fd of the requested object in the HTTP request.
- * @param[out] file_length The length of the requested object in the HTTP request.
  * 
  * @details
- * If opening the requested object fails, [fd] will be set to -1.
+ * The requested file, or the requested ranges of it, are appended to event->outq after the headers.
  * 
  * @return The result of parsing the HTTP request.
  */
-int create_response(struct hsevent *event, int *fd, size_t *file_length);
+int create_response(struct hsevent *event);
+
+/**
+ * @brief Write the body bytes that the pipe to a CGI script could not take yet.
+ */
+void response_cgi_body(struct hsevent *event);
 
 /**
  * @brief Generate an HTTP response to notify the peer timeout.
@@ -0,0 +1,71 @@
+/**
+ * @file scan.h
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ *
+ * @details
+ * This file declares the scanning kernels of the request parser.
+ *
+ * Every kernel has a scalar version and, on x86, SSE4.2 and AVX2 versions
+ * that examine 16 or 32 bytes per step. The best version supported by the CPU
+ * is selected at startup, so the binary does not require AVX2 to run.
+ */
+
+#ifndef HS_SCAN
+#define HS_SCAN
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HSSCAN_TOKEN 1   // tchar of RFC 7230
+#define HSSCAN_VALUE 2   // field-vchar, SP and HTAB of RFC 7230
+#define HSSCAN_URI   4   // Any visible character
+
+#define HSSCAN_SCALAR 0
+#define HSSCAN_SSE42  1
+#define HSSCAN_AVX2   2
+
+/**
+ * @brief The classes of every byte, a combination of HSSCAN_TOKEN, HSSCAN_VALUE and HSSCAN_URI.
+ */
+extern const uint8_t hsscan_class[256];
+
+/**
+ * @brief Search the empty line (\r\n\r\n) of the request headers.
+ *
+ * @param[in] buffer A pointer to the first byte of the request.
+ * @param[in] size The number of bytes in buffer.
+ * @param[in] start The smallest offset where the empty line may begin.
+ *
+ * @return The length of the request headers including the empty line, or 0 if not found.
+ */
+size_t hsscan_headers_end(const char *buffer, size_t size, size_t start);
+
+/**
+ * @brief Skip the bytes of class flags.
+ *
+ * @param[in] buffer A pointer to the bytes to be checked.
+ * @param[in] pos The offset of the first byte to check.
+ * @param[in] end The offset after the last byte to check.
+ * @param[in] flags One of HSSCAN_TOKEN, HSSCAN_VALUE and HSSCAN_URI.
+ *
+ * @return The offset of the first byte not in the class, or end.
+ */
+size_t hsscan_skip(const char *buffer, size_t pos, size_t end, int flags);
+
+/**
+ * @brief Select the kernels, e.g. to compare them in tests and benchmarks.
+ *
+ * @param[in] level HSSCAN_SCALAR, HSSCAN_SSE42 or HSSCAN_AVX2.
+ *
+ * @return The level actually selected, which is lower than level if the CPU does not support it.
+ */
+int hsscan_select(int level);
+
+/**
+ * @brief Return the name of the selected kernels.
+ */
+const char* hsscan_name();
+
+#endif  // HS_SCAN
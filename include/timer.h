@@ -0,0 +1,119 @@
+/**
+ * @file timer.h
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ *
+ * @details
+ * This file declares a hierarchical timing wheel and some functions related to it.
+ * The timing wheel replaces the per-connection timerfd,
+ * adding, refreshing and deleting a timer are O(1) memory operations without any syscall.
+ */
+
+#ifndef HS_TIMER
+#define HS_TIMER
+
+#include <stdint.h>
+
+#define HSTIMER_TICK   100  // Milliseconds per tick
+#define HSTIMER_BITS   6
+#define HSTIMER_SLOTS  (1 << HSTIMER_BITS)  // Slots per level
+#define HSTIMER_LEVELS 4    // 64^4 ticks, about 19 days
+
+struct hstimer;
+
+typedef void (*hstimer_cb)(struct hstimer *timer);
+
+/**
+ * @brief A timer that can be linked into the timing wheel.
+ *
+ * @details
+ * struct hstimer is embedded in the object it times (e.g. struct hsevent),
+ * so the timing wheel never allocates memory.
+ */
+struct hstimer {
+  struct hstimer *prev;   // Previous timer in the same slot
+  struct hstimer *next;   // Next timer in the same slot
+  uint64_t expire;        // Expiration time(ticks)
+  hstimer_cb cb;          // Called when the timer expires
+  void *data;             // Owner of the timer
+};
+
+/**
+ * @brief A hierarchical timing wheel.
+ *
+ * @details
+ * Level 0 has one slot per tick, and a slot of level n covers 64^n ticks.
+ * When the lower level wraps around,
+ * timers in the current slot of the upper level are cascaded down.
+ */
+struct hstimer_wheel {
+  struct hstimer slots[HSTIMER_LEVELS][HSTIMER_SLOTS]; // Sentinels of every slot
+  uint64_t now;           // Current time(ticks)
+  int num_of_timers;      // Number of pending timers
+};
+
+/**
+ * @brief Return the current monotonic time in milliseconds.
+ *
+ * @details
+ * CLOCK_MONOTONIC_COARSE is read through the vDSO, so no syscall is performed.
+ */
+uint64_t hstimer_now();
+
+/**
+ * @brief Initialize a timing wheel.
+ *
+ * @param[in] wheel A pointer to the timing wheel.
+ * @param[in] now_ms The current time in milliseconds.
+ */
+void hstimer_wheel_init(struct hstimer_wheel *wheel, uint64_t now_ms);
+
+/**
+ * @brief Initialize a timer, the timer is not pending after initialization.
+ *
+ * @param[in] timer A pointer to the timer.
+ * @param[in] cb The callback function called when the timer expires.
+ * @param[in] data The owner of the timer.
+ */
+void hstimer_init(struct hstimer *timer, hstimer_cb cb, void *data);
+
+/**
+ * @brief Add a timer to the timing wheel.
+ *
+ * @details
+ * If the timer is already pending, it will be rescheduled.
+ *
+ * @param[in] wheel A pointer to the timing wheel.
+ * @param[in] timer A pointer to the timer.
+ * @param[in] timeout_ms The timeout in milliseconds.
+ */
+void hstimer_add(struct hstimer_wheel *wheel, struct hstimer *timer, uint64_t timeout_ms);
+
+/**
+ * @brief Remove a timer from the timing wheel, no operation is performed if it is not pending.
+ */
+void hstimer_del(struct hstimer_wheel *wheel, struct hstimer *timer);
+
+/**
+ * @brief Return whether the timer is in the timing wheel.
+ */
+int hstimer_pending(const struct hstimer *timer);
+
+/**
+ * @brief Advance the timing wheel to now_ms and call the callbacks of all expired timers.
+ *
+ * @note
+ * The timer has been removed from the timing wheel when its callback is called,
+ * so the callback can add the timer again or free the owner of the timer.
+ */
+void hstimer_wheel_advance(struct hstimer_wheel *wheel, uint64_t now_ms);
+
+/**
+ * @brief Return the milliseconds until the next timer may expire.
+ *
+ * @return A timeout suitable for epoll_wait(), -1 if no timer is pending.
+ */
+int hstimer_wheel_timeout(const struct hstimer_wheel *wheel, uint64_t now_ms);
+
+#endif  // HS_TIMER
@@ -11,11 +11,17 @@
 #ifndef HS_UTILS
 #define HS_UTILS
 
+#include <stddef.h>
+
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 extern int http_port;
 extern int https_port;
+extern int num_workers;
+extern size_t cache_size;
+extern int send_mode;       // HSOUTQ_LATENCY or HSOUTQ_THROUGHPUT
+extern int idle_timeout;    // Seconds, HSINTERVAL by default
 
 /**
  * @brief Process the successfully parsed command line argument.
@@ -25,6 +31,11 @@ void process_argument(const char *option, const char *argument);
 /**
  * @brief Return a listening socket.
  * 
+ * @details
+ * SO_REUSEPORT is set before binding, 
+ * so every worker can bind its own listening socket to the same port 
+ * and let the kernel distribute new connections among them.
+ * 
  * @note
  * If you use http_port or https_port as parameter, 
  * check whether they have been initialized.
@@ -36,6 +47,15 @@ int hssocket(int port);
  */
 void set_nonblocking(int sockfd);
 
+/**
+ * @brief Disable Nagle's algorithm on sockfd.
+ *
+ * @details
+ * The queue of a response already coalesces the headers and the body,
+ * so a short tail must not wait for the ACK of the previous segment.
+ */
+void set_nodelay(int sockfd);
+
 /**
  * @brief Convert all characters of the string to cgi format.
  */
@@ -54,6 +54,9 @@ Request *parsing_request;
 	int i;
 }
 
+/* Name the unexpected token in syntax errors, bison 3.6 and later ignore YYERROR_VERBOSE */
+%define parse.error verbose
+
 %start request
 
 /*
@@ -206,26 +209,26 @@ request_line: token t_sp text t_sp text t_crlf {
 	YPRINTF("request_Line:\n%s\n%s\n%s\n",$1, $3,$5);
 	size_t token_size = (strlen($1) < 15 ? strlen($1) : 15);
   strncpy(parsing_request->http_method, $1, token_size + 1);
-
-	token_size = (strlen($3) < 255 ? strlen($3) : 255);
-	strncpy(parsing_request->http_uri, $3, token_size + 1);
-
+	parsing_request->http_uri = hsarena_strndup(&parsing_request->arena, $3, strlen($3));
+	if (!parsing_request->http_uri) {
+		YYABORT;
+	}
 	token_size = (strlen($5) < 15 ? strlen($5) : 15);
 	strncpy(parsing_request->http_version, $5, token_size + 1);
 }
 
 request_header: token ows t_colon ows text ows t_crlf {
 	YPRINTF("request_Header:\n%s\n%s\n",$1,$5);
-	size_t token_size = (strlen($1) < 127 ? strlen($1) : 127);
-  strncpy(parsing_request->headers[parsing_request->header_count].header_name, $1, token_size + 1);
-
-	token_size = (strlen($5) < 255 ? strlen($5) : 255);
-	strncpy(parsing_request->headers[parsing_request->header_count].header_value, $5, token_size + 1);
-	parsing_request->header_count++;
-	if (parsing_request->header_count == parsing_request->header_capacity) {
-		int capacity = (parsing_request->header_capacity *= 2);
-		// TODO(qds): Handle realloc() fails.
-		parsing_request->headers = (Request_header*)realloc(parsing_request->headers, sizeof(Request_header) * capacity);
+	/*
+	 * The name and the value are copied to the arena of the request,
+	 * so long values are not truncated, and a full header array
+	 * is replaced with one twice as large from the arena instead of realloc().
+	 */
+	size_t name_length = strlen($1);
+	size_t value_length = strlen($5);
+	if (request_add_header(parsing_request, $1, name_length, $5, value_length) < 0) {
+		// The arena is out of memory
+		YYABORT;
 	}
 };
 
@@ -19,16 +19,73 @@
 #include <errno.h>
 #include <signal.h>
 #include <stdio.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#define HSMAX_WORKERS 256
 
 struct hsevent_base *base;
 
+pid_t workers[HSMAX_WORKERS];
+int num_of_started = 0;
+
 void sig_handler(int signo) {
   printf("signo: %d\n", signo);
-  hsevent_base_clear(base);
-  hsevent_base_free(base);
+  if (base) {
+    struct hspool_stats stats = hspool_stats(base->pool);
+    printf("pool: %lu hits, %lu misses\n", (unsigned long)stats.hits, (unsigned long)stats.misses);
+    struct hsfcache_stats files = hsfcache_stats(base->files);
+    printf("files: %lu hits, %lu checks, %lu misses, %lu bytes in memory\n", 
+           (unsigned long)files.hits, (unsigned long)files.checks, (unsigned long)files.misses,
+           (unsigned long)files.memory);
+    hsevent_base_clear(base);
+    hsevent_base_free(base);
+  }
+  exit(0);
+}
+
+/**
+ * @brief Forward the signal to all workers and wait for them to exit.
+ */
+void master_sig_handler(int signo) {
+  for (int i = 0; i < num_of_started; i++) {
+    kill(workers[i], signo);
+  }
+  while (wait(NULL) > 0) {
+  }
   exit(0);
 }
 
+/**
+ * @brief Raise the soft limit on open files to the hard limit.
+ */
+void raise_fd_limit() {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+/**
+ * @brief Run an event loop with its own listening socket.
+ * 
+ * @details
+ * Every worker binds its own listening socket with SO_REUSEPORT, 
+ * so the kernel balances new connections among workers 
+ * and workers never share an accept queue or any per-request state.
+ */
+void run_worker() {
+  base = hsevent_base_init();
+
+  int serv_sockfd = hssocket(http_port);
+  set_nonblocking(serv_sockfd);
+  struct hsevent *listen_event = hsevent_init(serv_sockfd, EPOLLIN | EPOLLET, base);
+  hsevent_update_cb(listen_event, HSEVENT_READ, accept_conn);
+
+  hsevent_base_loop(base);
+}
+
 int main(int argc, char *argv[]) {
   if (argc < 2) {
     fputs("Server failed to start.\n", stderr);
@@ -48,6 +105,10 @@ int main(int argc, char *argv[]) {
       {"cgi", required_argument, 0, 0},
       {"key", required_argument, 0, 0},
       {"certificate", required_argument, 0, 0},
+      {"workers", required_argument, 0, 0},
+      {"cache", required_argument, 0, 0},
+      {"send", required_argument, 0, 0},
+      {"timeout", required_argument, 0, 0},
       {0, 0, 0, 0}
     };
     val = getopt_long(argc, argv, "", long_options, &option_index);
@@ -70,24 +131,33 @@ int main(int argc, char *argv[]) {
   }
 
   signal(SIGINT, sig_handler);
+  /* sendfile() can not take MSG_NOSIGNAL, a client that resets fails the send with EPIPE instead */
+  signal(SIGPIPE, SIG_IGN);
+  raise_fd_limit();
 
-  base = hsevent_base_init();
-
-  int serv_sockfd = hssocket(http_port);
-  set_nonblocking(serv_sockfd);
-  int i = 1;
-  setsockopt(serv_sockfd, SOL_SOCKET, SO_REUSEPORT, &i, sizeof(int));
-  struct hsevent *listen_event = hsevent_init(serv_sockfd, EPOLLIN | EPOLLET, base);
-  
-  /* Disarm listen_event's timer */
-  struct itimerspec timeout;
-  timeout.it_value.tv_nsec = 0;
-  timeout.it_value.tv_sec = 0;
-  timerfd_settime(listen_event->timerfd, 0, &timeout, NULL);
+  if (num_workers == 1) {
+    run_worker();
+    exit(0);
+  }
 
-  hsevent_update_cb(listen_event, HSEVENT_READ, accept_conn);
+  /* Each worker is a process, so globals such as the parser state are never shared */
+  num_workers = MIN(num_workers, HSMAX_WORKERS);
+  for (int i = 0; i < num_workers; i++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork()");
+      break;
+    } else if (pid == 0) {
+      run_worker();
+      exit(0);
+    }
+    workers[num_of_started++] = pid;
+  }
 
-  hsevent_base_loop(base);
+  signal(SIGINT, master_sig_handler);
+  signal(SIGTERM, master_sig_handler);
+  while (wait(NULL) > 0) {
+  }
 
   exit(0);
 }
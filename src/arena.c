@@ -0,0 +1,78 @@
+/**
+ * @file arena.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ */
+
+#include "arena.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HSARENA_ALIGN _Alignof(max_align_t)
+
+struct hsarena_chunk {
+  struct hsarena_chunk *prev;
+  _Alignas(max_align_t) char data[];
+};
+
+void hsarena_init(struct hsarena *arena, size_t first_size) {
+  arena->chunk = NULL;
+  arena->pos = arena->end = NULL;
+  arena->next_size = first_size ? first_size : HSARENA_CHUNK;
+}
+
+/**
+ * @brief Start a new chunk that can hold at least size bytes.
+ */
+static int chunk_add(struct hsarena *arena, size_t size) {
+  size_t chunk_size = arena->next_size > size ? arena->next_size : size;
+  struct hsarena_chunk *chunk = (struct hsarena_chunk*)malloc(sizeof(struct hsarena_chunk) + chunk_size);
+  if (!chunk) {
+    return -1;
+  }
+  chunk->prev = arena->chunk;
+  arena->chunk = chunk;
+  arena->pos = chunk->data;
+  arena->end = chunk->data + chunk_size;
+  arena->next_size = HSARENA_CHUNK;
+  return 0;
+}
+
+static void* arena_bump(struct hsarena *arena, size_t size, size_t align) {
+  uintptr_t pos = ((uintptr_t)arena->pos + align - 1) & ~(uintptr_t)(align - 1);
+  if (!arena->chunk || pos + size > (uintptr_t)arena->end) {
+    /* A new chunk starts aligned for any type */
+    if (chunk_add(arena, size) < 0) {
+      return NULL;
+    }
+    pos = (uintptr_t)arena->pos;
+  }
+  arena->pos = (char*)(pos + size);
+  return (void*)pos;
+}
+
+void* hsarena_alloc(struct hsarena *arena, size_t size) {
+  return arena_bump(arena, size, HSARENA_ALIGN);
+}
+
+char* hsarena_strndup(struct hsarena *arena, const char *str, size_t length) {
+  char *copy = (char*)arena_bump(arena, length + 1, 1);
+  if (copy) {
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+  }
+  return copy;
+}
+
+void hsarena_free(struct hsarena *arena) {
+  struct hsarena_chunk *chunk = arena->chunk;
+  while (chunk) {
+    struct hsarena_chunk *prev = chunk->prev;
+    free(chunk);
+    chunk = prev;
+  }
+  hsarena_init(arena, 0);
+}
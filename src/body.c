@@ -0,0 +1,187 @@
+/**
+ * @file body.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ */
+
+#include "body.h"
+
+#include <string.h>
+
+#define HSBODY_DONE        0   // No body is being read
+#define HSBODY_LENGTH      1   // remaining bytes framed by Content-Length
+#define HSBODY_CHUNK_SIZE  2   // Hex digits of the chunk size
+#define HSBODY_CHUNK_EXT   3   // Chunk extensions, ignored
+#define HSBODY_SIZE_LF     4   // \n after the chunk size line
+#define HSBODY_CHUNK_DATA  5   // remaining bytes of the chunk
+#define HSBODY_DATA_CR     6   // \r after the chunk data
+#define HSBODY_DATA_LF     7   // \n after the chunk data
+#define HSBODY_TRAILER     8   // First byte of a trailer field or of the empty line
+#define HSBODY_TRAILER_LINE 9  // Rest of a trailer field
+#define HSBODY_END_LF      10  // \n of the empty line
+
+#define HSBODY_MAX_DIGITS  15  // Chunk sizes up to 2^60 - 1
+
+void hsbody_init(struct hsbody *body) {
+  memset(body, 0, sizeof(struct hsbody));
+  body->state = HSBODY_DONE;
+}
+
+/**
+ * @brief Parse a Content-Length value, only digits are allowed.
+ */
+static int parse_length(const char *value, size_t length, uint64_t *result) {
+  if (length == 0 || length > 18) {
+    return -1;
+  }
+  *result = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (value[i] < '0' || value[i] > '9') {
+      return -1;
+    }
+    *result = *result * 10 + (uint64_t)(value[i] - '0');
+  }
+  return 0;
+}
+
+int hsbody_start(struct hsbody *body, const struct hsrequest *request) {
+  hsbody_init(body);
+  const struct hsrequest_header *length = hsrequest_get(request, HSHEADER_CONTENT_LENGTH);
+  const struct hsrequest_header *coding = hsrequest_get(request, HSHEADER_TRANSFER_ENCODING);
+  if (coding) {
+    /* A request with both can be framed differently by a proxy in front of the server */
+    if (length || !hsslice_equal_nocase(request, coding->value, "chunked")) {
+      return -1;
+    }
+    body->state = HSBODY_CHUNK_SIZE;
+  } else if (length) {
+    if (parse_length(hsrequest_ptr(request, length->value), length->value.length, &body->remaining) < 0) {
+      return -1;
+    }
+    body->state = HSBODY_LENGTH;
+  } else {
+    body->state = HSBODY_LENGTH;  // No body, ends on the first hsbody_feed()
+  }
+  return 0;
+}
+
+static int hex_value(char ch) {
+  if (ch >= '0' && ch <= '9') {
+    return ch - '0';
+  }
+  ch |= 0x20;
+  if (ch >= 'a' && ch <= 'f') {
+    return ch - 'a' + 10;
+  }
+  return -1;
+}
+
+static void deliver(struct hsbody *body, const char *data, size_t size) {
+  body->received += size;
+  if (body->sink) {
+    body->sink(body->ctx, data, size);
+  }
+}
+
+static void finish(struct hsbody *body) {
+  body->state = HSBODY_DONE;
+  if (body->sink) {
+    body->sink(body->ctx, NULL, 0);
+  }
+}
+
+ssize_t hsbody_feed(struct hsbody *body, const char *data, size_t size) {
+  size_t pos = 0;
+  while (body->state != HSBODY_DONE) {
+    if (body->state == HSBODY_LENGTH || body->state == HSBODY_CHUNK_DATA) {
+      size_t length = body->remaining < size - pos ? (size_t)body->remaining : size - pos;
+      if (length > 0) {
+        deliver(body, data + pos, length);
+        pos += length;
+        body->remaining -= length;
+      }
+      if (body->remaining > 0) {
+        break;
+      }
+      if (body->state == HSBODY_LENGTH) {
+        finish(body);
+      } else {
+        body->state = HSBODY_DATA_CR;
+      }
+      continue;
+    }
+
+    /* The framing of chunks, one byte at a time */
+    if (pos == size) {
+      break;
+    }
+    char ch = data[pos++];
+    switch (body->state) {
+      case HSBODY_CHUNK_SIZE: {
+        int digit = hex_value(ch);
+        if (digit >= 0 && body->chunk_size < ((uint64_t)1 << (4 * (HSBODY_MAX_DIGITS - 1)))) {
+          body->chunk_size = body->chunk_size * 16 + (uint64_t)digit;
+          body->remaining++;  // Counts the digits until the size is complete
+        } else if (body->remaining > 0 && (ch == ';' || ch == ' ' || ch == '\t')) {
+          body->state = HSBODY_CHUNK_EXT;
+        } else if (body->remaining > 0 && ch == '\r') {
+          body->state = HSBODY_SIZE_LF;
+        } else {
+          goto malformed;
+        }
+        break;
+      }
+      case HSBODY_CHUNK_EXT:
+        if (ch == '\r') {
+          body->state = HSBODY_SIZE_LF;
+        } else if (ch == '\n') {
+          goto malformed;
+        }
+        break;
+      case HSBODY_SIZE_LF:
+        if (ch != '\n') {
+          goto malformed;
+        }
+        body->remaining = body->chunk_size;
+        body->state = body->chunk_size ? HSBODY_CHUNK_DATA : HSBODY_TRAILER;
+        body->chunk_size = 0;
+        break;
+      case HSBODY_DATA_CR:
+        if (ch != '\r') {
+          goto malformed;
+        }
+        body->state = HSBODY_DATA_LF;
+        break;
+      case HSBODY_DATA_LF:
+        if (ch != '\n') {
+          goto malformed;
+        }
+        body->state = HSBODY_CHUNK_SIZE;
+        break;
+      case HSBODY_TRAILER:
+        body->state = ch == '\r' ? HSBODY_END_LF : HSBODY_TRAILER_LINE;
+        break;
+      case HSBODY_TRAILER_LINE:
+        if (ch == '\n') {
+          body->state = HSBODY_TRAILER;
+        }
+        break;
+      case HSBODY_END_LF:
+        if (ch != '\n') {
+          goto malformed;
+        }
+        finish(body);
+        break;
+    }
+  }
+  return (ssize_t)pos;
+
+malformed:
+  finish(body);
+  return -1;
+}
+
+int hsbody_done(const struct hsbody *body) {
+  return body->state == HSBODY_DONE;
+}
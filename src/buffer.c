@@ -5,12 +5,17 @@
  * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
  */
 
+#define _GNU_SOURCE
+
 #include "buffer.h"
 #include "utils.h"
 
 #include <stdlib.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
 
 struct hsbuffer {
   char* data;           // Point to the memory allocated for the hsbuffer
@@ -18,23 +23,123 @@ struct hsbuffer {
   size_t write_pos;     // Writable position in the hsbuffer
   size_t used_length;   // The size of the hsbuffer that has been used
   size_t capacity;      // The maximum number of bytes that the hsbuffer can hold
+  size_t init_capacity; // The capacity restored by hsbuffer_release()
+  struct hspool *pool;  // The pool that data and the hsbuffer come from, NULL means malloc()
+  size_t ring_size;     // Size of one mapping of a ring hsbuffer, 0 for a linear hsbuffer
 };
 
+/**
+ * @brief Map a memfd region of size bytes twice, back to back.
+ * 
+ * @details
+ * A byte at offset i is also visible at offset i + size, 
+ * so any size bytes starting in the first mapping are contiguous.
+ * 
+ * @return A pointer to the first mapping, or NULL if failed.
+ */
+static char* ring_map(size_t size) {
+  int fd = memfd_create("hsbuffer", MFD_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (ftruncate(fd, size) < 0) {
+    close(fd);
+    return NULL;
+  }
+  char *data = (char*)mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  if (mmap(data, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+      mmap(data + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(data, size * 2);
+    close(fd);
+    return NULL;
+  }
+  close(fd);  // The mappings keep the memory alive
+  return data;
+}
+
+/**
+ * @return The smallest multiple of the page size that can hold buffer_size bytes and the null terminator.
+ */
+static size_t ring_round(size_t buffer_size) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return (buffer_size + 1 + page - 1) / page * page;
+}
+
+/**
+ * @brief Return the capacity of a data block that can hold buffer_size bytes.
+ * 
+ * @details
+ * A data block is always capacity + 1 bytes, the extra byte is reserved for the null terminator. 
+ * With a pool, the block fills its whole size class.
+ */
+static size_t block_capacity(struct hspool *pool, size_t buffer_size) {
+  return pool ? hspool_class_size(buffer_size) - 1 : buffer_size;
+}
+
+/**
+ * @brief Allocate the data block of a lazy hsbuffer.
+ * 
+ * @return 0 on success, or -1 if out of memory.
+ */
+static int buffer_reserve(struct hsbuffer *ptr) {
+  if (ptr->data) {
+    return 0;
+  }
+  ptr->data = (char*)hspool_alloc(ptr->pool, ptr->capacity + 1);
+  if (!ptr->data) {
+    return -1;
+  }
+  ptr->data[0] = '\0';
+  return 0;
+}
+
 struct hsbuffer* hsbuffer_init(uint32_t buffer_size) {
+  return hsbuffer_init_pool(NULL, buffer_size);
+}
+
+struct hsbuffer* hsbuffer_init_pool(struct hspool *pool, uint32_t buffer_size) {
+  struct hsbuffer *ptr = (struct hsbuffer*)hspool_alloc(pool, sizeof(struct hsbuffer));
+  if (!ptr) {
+    return NULL;
+  }
+  ptr->pool = pool;
+  ptr->ring_size = 0;
+  ptr->capacity = block_capacity(pool, buffer_size);
+  ptr->init_capacity = ptr->capacity;
+  ptr->data = NULL;
+  ptr->used_length = 0;
+  ptr->read_pos = 0;
+  ptr->write_pos = 0;
+
+  /* Data of a pooled hsbuffer is allocated on first use */
+  if (!pool && buffer_reserve(ptr) < 0) {
+    free(ptr);
+    return NULL;
+  }
+  return ptr;
+}
+
+struct hsbuffer* hsbuffer_init_ring(uint32_t buffer_size) {
   struct hsbuffer *ptr = (struct hsbuffer*)malloc(sizeof(struct hsbuffer));
   if (!ptr) {
     return NULL;
   }
-  ptr->data = (char*)malloc(buffer_size + 1);   // Reserve a space for the null terminator
+  ptr->pool = NULL;
+  ptr->ring_size = ring_round(buffer_size);
+  ptr->capacity = ptr->init_capacity = ptr->ring_size - 1;
+  ptr->data = ring_map(ptr->ring_size);
   if (!ptr->data) {
     free(ptr);
     return NULL;
   }
-  ptr->capacity = buffer_size;
+  ptr->data[0] = '\0';
   ptr->used_length = 0;
   ptr->read_pos = 0;
   ptr->write_pos = 0;
-
   return ptr;
 }
 
@@ -42,13 +147,35 @@ void hsbuffer_free(struct hsbuffer *ptr) {
   if (!ptr) {
     return ;
   }
-  if (ptr->data) {
-    free(ptr->data);
+  if (ptr->ring_size) {
+    munmap(ptr->data, ptr->ring_size * 2);
+    free(ptr);
+    return ;
   }
-  free(ptr);
+  hspool_put(ptr->pool, ptr->data, ptr->capacity + 1);
+  hspool_put(ptr->pool, ptr, sizeof(struct hsbuffer));
+}
+
+void hsbuffer_release(struct hsbuffer *ptr) {
+  if (!ptr->data || ptr->ring_size || ptr->read_pos != ptr->write_pos) {
+    return ;
+  }
+  hspool_put(ptr->pool, ptr->data, ptr->capacity + 1);
+  ptr->data = NULL;
+  ptr->capacity = ptr->init_capacity;
+  ptr->used_length = 0;
+  ptr->read_pos = 0;
+  ptr->write_pos = 0;
+}
+
+int hsbuffer_allocated(const struct hsbuffer *ptr) {
+  return ptr->data != NULL;
 }
 
 char* hsbuffer_pos(struct hsbuffer *ptr, int pos_type) {
+  if (buffer_reserve(ptr) < 0) {
+    return NULL;
+  }
   char *data = ptr->data;
   switch (pos_type) {
     case READ_POS: {
@@ -77,6 +204,9 @@ size_t hsbuffer_capacity(const struct hsbuffer *ptr) {
 }
 
 size_t hsbuffer_remain(const struct hsbuffer *ptr) {
+  if (ptr->ring_size) {
+    return ptr->capacity - (ptr->write_pos - ptr->read_pos);
+  }
   return ptr->capacity - ptr->used_length;
 }
 
@@ -87,15 +217,23 @@ size_t hsbuffer_readable(const struct hsbuffer *ptr) {
 ssize_t hsbuffer_recv(int sockfd, struct hsbuffer *ptr, size_t length) {
   length = MIN(hsbuffer_remain(ptr), length);
   char *buf = hsbuffer_pos(ptr, WRITE_POS);
+  if (!buf) {
+    errno = ENOMEM;
+    return -1;
+  }
   ssize_t bytes_recv = 0;
   if ((bytes_recv = recv(sockfd, (void*)buf, length, 0)) > 0) {
-    ptr->write_pos += (size_t)bytes_recv;
-    ptr->used_length += (size_t)bytes_recv;
-    ptr->data[ptr->write_pos] = '\0';
+    hsbuffer_fill(ptr, (size_t)bytes_recv);
   }
   return bytes_recv;
 }
 
+void hsbuffer_fill(struct hsbuffer *ptr, size_t length) {
+  ptr->write_pos += length;
+  ptr->used_length += length;
+  ptr->data[ptr->write_pos] = '\0';
+}
+
 ssize_t hsbuffer_send(int sockfd, struct hsbuffer *ptr, size_t length) {
   length = MIN(ptr->write_pos - ptr->read_pos, length);
   char *buf = hsbuffer_pos(ptr, READ_POS);
@@ -112,23 +250,82 @@ void hsbuffer_expand(struct hsbuffer *ptr, size_t new_capacity) {
     return ;
   }
 
-  char *new_data;
-  if ((new_data = (char*)realloc((void*)ptr->data, new_capacity + 1)) != NULL) { // Reserve a space for the null terminator
+  if (ptr->ring_size) {
+    /* Only the readable bytes are moved, the new ring starts at offset 0 */
+    size_t ring_size = ring_round(new_capacity);
+    char *new_data = ring_map(ring_size);
+    if (new_data) {
+      size_t readable = ptr->write_pos - ptr->read_pos;
+      memcpy(new_data, ptr->data + ptr->read_pos, readable);
+      new_data[readable] = '\0';
+      munmap(ptr->data, ptr->ring_size * 2);
+      ptr->data = new_data;
+      ptr->ring_size = ring_size;
+      ptr->capacity = ring_size - 1;
+      ptr->read_pos = 0;
+      ptr->write_pos = ptr->used_length = readable;
+    }
+    return ;
+  }
+
+  if (!ptr->data) {
+    /* Nothing to move, the next allocation will be large enough */
+    ptr->capacity = block_capacity(ptr->pool, ptr->pool ? new_capacity + 1 : new_capacity);
+    return ;
+  }
+
+  if (!ptr->pool) {
+    char *new_data;
+    if ((new_data = (char*)realloc((void*)ptr->data, new_capacity + 1)) != NULL) { // Reserve a space for the null terminator
+      ptr->data = new_data;
+      ptr->capacity = new_capacity;
+    } 
+    return ;
+  }
+
+  /* Move the data to a block of a larger class */
+  size_t capacity = block_capacity(ptr->pool, new_capacity + 1);
+  char *new_data = (char*)hspool_alloc(ptr->pool, capacity + 1);
+  if (new_data) {
+    memcpy(new_data, ptr->data, ptr->write_pos + 1);
+    hspool_put(ptr->pool, ptr->data, ptr->capacity + 1);
     ptr->data = new_data;
-    ptr->capacity = new_capacity;
-  } 
+    ptr->capacity = capacity;
+  }
 }
 
 void hsbuffer_ncpy(struct hsbuffer *ptr, const char *src, size_t length) {
-  strncpy(hsbuffer_pos(ptr, WRITE_POS), src, length);
+  char *buf = hsbuffer_pos(ptr, WRITE_POS);
+  if (!buf) {
+    return ;
+  }
+  strncpy(buf, src, length);
   ptr->write_pos += length;
 }
 
+void hsbuffer_compact(struct hsbuffer *ptr) {
+  if (ptr->ring_size || ptr->read_pos == 0) {
+    return ;
+  }
+  size_t readable = ptr->write_pos - ptr->read_pos;
+  memmove(ptr->data, ptr->data + ptr->read_pos, readable);
+  ptr->data[readable] = '\0';
+  ptr->read_pos = 0;
+  ptr->write_pos = ptr->used_length = readable;
+}
+
 void hsbuffer_consume(struct hsbuffer *ptr, size_t length) {
   length = MIN(ptr->write_pos - ptr->read_pos, length);
   ptr->read_pos += length;
   if (ptr->read_pos == ptr->write_pos) {
     ptr->read_pos = ptr->write_pos = 0;
     ptr->used_length = 0;
+  } else if (ptr->ring_size) {
+    /* Keep read_pos in the first mapping, the bytes before it can be written again */
+    if (ptr->read_pos >= ptr->ring_size) {
+      ptr->read_pos -= ptr->ring_size;
+      ptr->write_pos -= ptr->ring_size;
+    }
+    ptr->used_length = ptr->write_pos - ptr->read_pos;
   }
 }
@@ -6,32 +6,79 @@
  */
 
 #include "event.h"
+#include "utils.h"
+
+#include <stddef.h>
+#include <errno.h>
+
+static void link_init(struct hsevent_link *link) {
+  link->prev = link->next = link;
+}
+
+static void link_remove(struct hsevent_link *link) {
+  link->prev->next = link->next;
+  link->next->prev = link->prev;
+  link_init(link);
+}
+
+static void link_append(struct hsevent_link *head, struct hsevent_link *link) {
+  link->prev = head->prev;
+  link->next = head;
+  head->prev->next = link;
+  head->prev = link;
+}
+
+static struct hsevent* link_event(struct hsevent_link *link) {
+  return (struct hsevent*)((char*)link - offsetof(struct hsevent, pending_link));
+}
+
+static void hsevent_expire(struct hstimer *timer) {
+  struct hsevent *event = (struct hsevent*)timer->data;
+  if (event->timeout_cb) {
+    event->timeout_cb(event);
+  }
+}
 
 struct hsevent* hsevent_init(int sockfd, int events, struct hsevent_base *event_base) {
-  struct hsevent *event = (struct hsevent*)malloc(sizeof(struct hsevent));
+  struct hspool *pool = event_base ? event_base->pool : NULL;
+  struct hsevent *event = (struct hsevent*)hspool_alloc(pool, sizeof(struct hsevent));
   if (event == NULL) {
     return event;
   }
-  event->inbound = hsbuffer_init(HS_BUFFER_SIZE);
-  event->outbound = hsbuffer_init(HS_BUFFER_SIZE);
-  if (!event->inbound || !event->outbound) {
+  event->pool = pool;
+#ifdef HS_RING_BUFFER
+  event->inbound = hsbuffer_init_ring(HS_BUFFER_SIZE);
+#else
+  event->inbound = hsbuffer_init_pool(pool, HS_BUFFER_SIZE);
+#endif
+  event->outbound = hsbuffer_init_pool(pool, HS_BUFFER_SIZE);
+  event->remote = (struct sockaddr_in*)hspool_alloc(pool, sizeof(struct sockaddr_in));
+  event->outq = event->outbound ? hsoutq_init(pool, event->outbound) : NULL;
+  if (!event->inbound || !event->outbound || !event->remote || !event->outq) {
+    hsoutq_free(event->outq);
     hsbuffer_free(event->inbound);
     hsbuffer_free(event->outbound);
-    free(event);
+    hspool_put(pool, event->remote, sizeof(struct sockaddr_in));
+    hspool_put(pool, event, sizeof(struct hsevent));
     return NULL;
   }
+  hsoutq_set_mode(event->outq, send_mode);
   event->sockfd = sockfd;
   event->events = events;
   event->pipe_rfd = -1;
+  event->pipe_wfd = -1;
+  event->pipe_pending = NULL;
+  event->pipe_length = 0;
+  event->pipe_eof = 0;
+  hsparser_init(&event->parser);
+  hsbody_init(&event->body);
   event->closed = 0;
-  event->remote = (struct sockaddr_in*)malloc(sizeof(struct sockaddr_in));
-  event->timerfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK);
-  struct itimerspec timeout;
-  timeout.it_value.tv_nsec = 0;
-  timeout.it_value.tv_sec = HSINTERVAL;
-  timeout.it_interval.tv_nsec = 0;
-  timeout.it_interval.tv_sec = HSINTERVAL;
-  timerfd_settime(event->timerfd, 0, &timeout, NULL);
+  event->unread = 0;
+  event->read_cb = event->write_cb = event->rdhup_cb = event->err_cb = event->timeout_cb = NULL;
+  hstimer_init(&event->timer, hsevent_expire, event);
+  link_init(&event->pending_link);
+  event->pending = 0;
+  event->event_base = NULL;
   if (event->events) {
     event->event_base = event_base;
     if (event->event_base) {
@@ -43,10 +90,16 @@ struct hsevent* hsevent_init(int sockfd, int events, struct hsevent_base *event_
 }
 
 void hsevent_free(struct hsevent *event) {
+  link_remove(&event->pending_link);
+  if (event->event_base) {
+    hstimer_del(&event->event_base->timers, &event->timer);
+  }
+  hsoutq_free(event->outq);
   hsbuffer_free(event->inbound);
   hsbuffer_free(event->outbound);
-  free(event->remote);
-  free(event);
+  free(event->pipe_pending);
+  hspool_put(event->pool, event->remote, sizeof(struct sockaddr_in));
+  hspool_put(event->pool, event, sizeof(struct hsevent));
 }
 
 void hsevent_update(struct hsevent *event, int events) {
@@ -74,61 +127,244 @@ void hsevent_update_cb(struct hsevent *event, int event_type, hsevent_cb event_c
       event->err_cb = event_cb;
       break;
     }
+    case HSEVENT_TIMEOUT: {
+      event->timeout_cb = event_cb;
+      break;
+    }
     default: {
       break;
     }
   }
 }
 
+/**
+ * @brief Make sure fd can be used as an index of the slot table.
+ * 
+ * @return 0 on success, or -1 if out of memory.
+ */
+static int hsevent_base_reserve(struct hsevent_base *base, int fd) {
+  if (fd < base->num_of_slots) {
+    return 0;
+  }
+  int num_of_slots = base->num_of_slots;
+  while (num_of_slots <= fd) {
+    num_of_slots *= 2;
+  }
+  struct hsevent **sockets = (struct hsevent**)realloc(base->sockets, num_of_slots * sizeof(struct hsevent*));
+  if (!sockets) {
+    return -1;
+  }
+  memset(sockets + base->num_of_slots, 0, (num_of_slots - base->num_of_slots) * sizeof(struct hsevent*));
+  base->sockets = sockets;
+  uint32_t *generations = (uint32_t*)realloc(base->generations, num_of_slots * sizeof(uint32_t));
+  if (!generations) {
+    return -1;
+  }
+  memset(generations + base->num_of_slots, 0, (num_of_slots - base->num_of_slots) * sizeof(uint32_t));
+  base->generations = generations;
+  base->num_of_slots = num_of_slots;
+  return 0;
+}
+
+static void hsevent_base_set(struct hsevent_base *base, int fd, struct hsevent *event) {
+  if (fd >= 0 && fd < base->num_of_slots) {
+    base->sockets[fd] = event;
+    base->generations[fd]++;
+  }
+}
+
+/**
+ * @brief The data registered with fd, (generation << 32 | fd).
+ * 
+ * An event polled before fd was closed and reused carries an old generation, it is dropped.
+ */
+static uint64_t hsevent_base_token(struct hsevent_base *base, int fd) {
+  return ((uint64_t)base->generations[fd] << 32) | (uint32_t)fd;
+}
+
+void hsevent_activate(struct hsevent *event, uint32_t events) {
+  if (!event->event_base) {
+    return ;
+  }
+  event->pending |= events;
+  if (event->pending_link.next == &event->pending_link) {
+    link_append(&event->event_base->pending, &event->pending_link);
+  }
+}
+
+void hsevent_update_timer(struct hsevent *event, int seconds) {
+  if (!event->event_base) {
+    return ;
+  }
+  if (seconds > 0) {
+    hstimer_add(&event->event_base->timers, &event->timer, (uint64_t)seconds * 1000);
+  } else {
+    hstimer_del(&event->event_base->timers, &event->timer);
+  }
+}
+
+int hsevent_accept(struct hsevent *event, struct sockaddr *addr, socklen_t *addrlen) {
+  if (!event->event_base) {
+    return accept(event->sockfd, addr, addrlen);
+  }
+  return hspoller_accept(event->event_base->poller, event->sockfd, addr, addrlen);
+}
+
+ssize_t hsevent_recv(struct hsevent *event, size_t length) {
+  if (!event->event_base) {
+    return hsbuffer_recv(event->sockfd, event->inbound, length);
+  }
+  length = MIN(hsbuffer_remain(event->inbound), length);
+  char *buf = hsbuffer_pos(event->inbound, WRITE_POS);
+  if (!buf) {
+    errno = ENOMEM;
+    return -1;
+  }
+  ssize_t bytes_recv = hspoller_recv(event->event_base->poller, event->sockfd, buf, length);
+  if (bytes_recv > 0) {
+    hsbuffer_fill(event->inbound, (size_t)bytes_recv);
+  }
+  return bytes_recv;
+}
+
 struct hsevent_base* hsevent_base_init() {
   struct hsevent_base *base = (struct hsevent_base*)malloc(sizeof(struct hsevent_base));
   if (!base) {
     return base;
   }
-  base->epollfd = epoll_create1(0);
-  base->exit = 0;
-  memset(base->activate_events, 0, MAXFD * sizeof(struct epoll_event));
-  for (int i = 0; i < MAXFD; i++) {
-    base->sockets[i] = NULL;
+  base->activate_events = (struct epoll_event*)calloc(HSEVENT_BATCH, sizeof(struct epoll_event));
+  base->sockets = (struct hsevent**)calloc(HSEVENT_SLOTS, sizeof(struct hsevent*));
+  base->generations = (uint32_t*)calloc(HSEVENT_SLOTS, sizeof(uint32_t));
+  if (!base->activate_events || !base->sockets || !base->generations) {
+    free(base->activate_events);
+    free(base->sockets);
+    free(base->generations);
+    free(base);
+    return NULL;
+  }
+  base->poller = hspoller_init();
+  base->pool = hspool_init();
+  base->files = hsfcache_init(HSFCACHE_FILES, HSFCACHE_TTL, cache_size);
+  if (!base->poller || !base->pool || !base->files) {
+    if (base->poller) {
+      hspoller_free(base->poller);
+    }
+    hspool_free(base->pool);
+    hsfcache_free(base->files);
+    free(base->activate_events);
+    free(base->sockets);
+    free(base->generations);
+    free(base);
+    return NULL;
   }
+  base->num_of_slots = HSEVENT_SLOTS;
+  base->now = hstimer_now();
+  hstimer_wheel_init(&base->timers, base->now);
+  link_init(&base->pending);
+  base->exit = 0;
 
   return base;
 }
 
 void hsevent_base_free(struct hsevent_base *base) {
+  hspoller_free(base->poller);
+  hspool_free(base->pool);
+  hsfcache_free(base->files);
+  free(base->activate_events);
+  free(base->sockets);
+  free(base->generations);
   free(base);
 }
 
 void hsevent_base_update(int op, struct hsevent *event, struct hsevent_base *base) {
-  struct epoll_event ev, timerev;
-  ev.events = event->events;
-  ev.data.fd = event->sockfd;
-  timerev.events = EPOLLIN | EPOLLET;
-  timerev.data.fd = event->timerfd;
-  epoll_ctl(base->epollfd, op, event->sockfd, &ev);
-  epoll_ctl(base->epollfd, op, event->timerfd, &timerev);
   if (op == EPOLL_CTL_ADD) {
-    base->sockets[event->sockfd] = event;
-    base->sockets[event->timerfd] = event;
+    if (hsevent_base_reserve(base, event->sockfd) < 0) {
+      return ;
+    }
+    hsevent_base_set(base, event->sockfd, event);
   } else if (op == EPOLL_CTL_DEL) {
-    base->sockets[event->sockfd] = NULL;
-    base->sockets[event->timerfd] = NULL;
-    base->sockets[event->pipe_rfd] = NULL;
+    hsevent_base_set(base, event->sockfd, NULL);
+    if (event->pipe_rfd >= 0) {
+      hsevent_base_set(base, event->pipe_rfd, NULL);
+      hspoller_ctl(base->poller, EPOLL_CTL_DEL, event->pipe_rfd, 0, 0);
+    }
+    if (event->pipe_wfd >= 0) {
+      hsevent_base_detach(event->pipe_wfd, event);
+    }
+    hstimer_del(&base->timers, &event->timer);
+    link_remove(&event->pending_link);
+    event->pending = 0;
+    hspoller_ctl(base->poller, op, event->sockfd, event->events, 0);
+    return ;
+  }
+  hspoller_ctl(base->poller, op, event->sockfd, event->events, hsevent_base_token(base, event->sockfd));
+}
+
+int hsevent_base_attach(int fd, int events, struct hsevent *event) {
+  struct hsevent_base *base = event->event_base;
+  if (hsevent_base_reserve(base, fd) < 0) {
+    return -1;
+  }
+  hsevent_base_set(base, fd, event);
+  if (hspoller_ctl(base->poller, EPOLL_CTL_ADD, fd, events, hsevent_base_token(base, fd)) < 0) {
+    hsevent_base_set(base, fd, NULL);
+    return -1;
   }
+  return 0;
+}
+
+void hsevent_base_detach(int fd, struct hsevent *event) {
+  struct hsevent_base *base = event->event_base;
+  hsevent_base_set(base, fd, NULL);
+  hspoller_ctl(base->poller, EPOLL_CTL_DEL, fd, 0, 0);
 }
 
 void hsevent_base_clear(struct hsevent_base *base) {
-  for (int i = 0; i < MAXFD; i++) {
+  for (int i = 0; i < base->num_of_slots; i++) {
     if (base->sockets[i]) {
       struct hsevent *event = base->sockets[i];
-      base->sockets[event->sockfd] = NULL;
-      base->sockets[event->timerfd] = NULL;
-      base->sockets[event->pipe_rfd] = NULL;
+      hsevent_base_set(base, event->sockfd, NULL);
+      hsevent_base_set(base, event->pipe_rfd, NULL);
+      hsevent_base_set(base, event->pipe_wfd, NULL);
       hsevent_free(event);
     }
   }
 }
 
+/**
+ * @brief Whether event is still registered on fd, it may have been freed by its callbacks.
+ * 
+ * The generation tells a recycled event registered on the same fd again from the original one.
+ */
+static int hsevent_alive(struct hsevent_base *base, int fd, struct hsevent *event, uint32_t generation) {
+  return fd >= 0 && fd < base->num_of_slots && base->sockets[fd] == event &&
+         base->generations[fd] == generation;
+}
+
+static void hsevent_dispatch(struct hsevent_base *base, int fd, struct hsevent *event, uint32_t events) {
+  uint32_t generation = base->generations[fd];
+  if ((events & EPOLLERR) && event->err_cb) {
+    event->err_cb(event);
+    return ;
+  }
+  if ((events & EPOLLIN) && event->read_cb) {
+    event->read_cb(event);
+    if (!hsevent_alive(base, fd, event, generation)) {
+      return ;
+    }
+  }
+  /* Without err_cb, the write callback finds the error, e.g. a pipe whose reader has exited */
+  if ((events & (EPOLLOUT | EPOLLERR)) && event->write_cb) {
+    event->write_cb(event);
+    if (!hsevent_alive(base, fd, event, generation)) {
+      return ;
+    }
+  }
+  if ((events & (EPOLLRDHUP | EPOLLHUP)) && event->rdhup_cb) {
+    event->rdhup_cb(event);
+  }
+}
+
 void hsevent_base_loop(struct hsevent_base *base) {
   while (1) {
     /* For debug */
@@ -136,30 +372,40 @@ void hsevent_base_loop(struct hsevent_base *base) {
       return ;
     }
 
-    int nready = epoll_wait(base->epollfd, base->activate_events, MAXFD, -1);
+    int timeout = hstimer_wheel_timeout(&base->timers, base->now);
+    if (base->pending.next != &base->pending) {
+      timeout = 0;
+    }
+    int nready = hspoller_wait(base->poller, base->activate_events, HSEVENT_BATCH, timeout);
+    base->now = hstimer_now();
+    hstimer_wheel_advance(&base->timers, base->now);
     for (int i = 0; i < nready; i++) {
-      int sockfd = base->activate_events[i].data.fd;
-      int events = base->activate_events[i].events;
-      struct hsevent *activate_event = base->sockets[sockfd];
-      if (events & EPOLLERR) {
-        if (activate_event->err_cb) {
-          activate_event->err_cb(activate_event);
-        }
-        continue;
-      } else if(events & EPOLLRDHUP) {
-        if (activate_event->rdhup_cb) {
-          activate_event->rdhup_cb(activate_event);
-        }
-        continue;
-      } else if(events & EPOLLIN) {
-        if (activate_event->read_cb) {
-          activate_event->read_cb(activate_event);
-        }
-      } else if(events & EPOLLOUT) {
-        if (activate_event->write_cb) {
-          activate_event->write_cb(activate_event);
-        }
+      uint64_t token = base->activate_events[i].data.u64;
+      int fd = (int)(uint32_t)token;
+      uint32_t events = base->activate_events[i].events;
+      struct hsevent *activate_event = base->sockets[fd];
+      if (!activate_event || base->generations[fd] != (uint32_t)(token >> 32)) {
+        continue; // Closed by a previous callback in this batch, fd may have been reused since
       }
+      hsevent_dispatch(base, fd, activate_event, events);
+    }
+
+    /* Resume the work left by callbacks, events activated from now on wait for the next iteration */
+    struct hsevent_link pending;
+    link_init(&pending);
+    if (base->pending.next != &base->pending) {
+      pending.next = base->pending.next;
+      pending.prev = base->pending.prev;
+      pending.next->prev = &pending;
+      pending.prev->next = &pending;
+      link_init(&base->pending);
+    }
+    while (pending.next != &pending) {
+      struct hsevent *activate_event = link_event(pending.next);
+      uint32_t events = activate_event->pending;
+      link_remove(&activate_event->pending_link);
+      activate_event->pending = 0;
+      hsevent_dispatch(base, activate_event->sockfd, activate_event, events);
     }
   }
 }
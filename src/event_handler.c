@@ -1,5 +1,5 @@
 /**
- * @file utils.c
+ * @file event_handler.c
  * @author Quan.Dashuai
  * @version 1.0
  * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
@@ -15,33 +15,100 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <errno.h>
-#include <sys/sendfile.h>
-
-static void outbound_send(struct hsevent *event) {
-  ssize_t total_written = hsbuffer_readable(event->outbound);
-  while (total_written > 0) {
-    ssize_t bytes_written = hsbuffer_send(event->sockfd, event->outbound, total_written);
-    if (bytes_written < 0) {
-      perror("send() failed");
-      break;
-    }
-    total_written -= bytes_written;
+
+/**
+ * @brief Send the output chain of the connection, at most HSEVENT_SEND_BUDGET bytes.
+ * 
+ * @details
+ * A connection that makes progress is not idle, so a slow reader of a long download is not timed out.
+ * 
+ * @return 1 if all output has been sent, 0 if the socket would block, 
+ * 2 if the budget has been used up, -1 if an error occured.
+ */
+static int flush_conn(struct hsevent *event) {
+  size_t pending = hsoutq_pending(event->outq);
+  int result = hsoutq_flush(event->outq, event->sockfd, HSEVENT_SEND_BUDGET);
+  if (hsoutq_pending(event->outq) < pending) {
+    hsevent_update_timer(event, idle_timeout);
   }
+  return result;
 }
 
 static void close_event(struct hsevent *event) {
   hsevent_base_update(EPOLL_CTL_DEL, event, event->event_base);
   close(event->sockfd);
-  close(event->timerfd);
   close(event->pipe_rfd);
+  close(event->pipe_wfd);
   hsevent_free(event);
 }
 
+/**
+ * @brief Whether some output waits for the socket or the CGI pipe, or for the next loop iteration.
+ */
+static int output_blocked(struct hsevent *event) {
+  return hsoutq_pending(event->outq) > 0 || (event->events & EPOLLOUT) || event->pipe_length > 0;
+}
+
+/**
+ * @brief Generate responses for all complete requests and send them immediately.
+ * 
+ * @details
+ * EPOLLOUT is only monitored while some output is blocked by a full socket buffer, 
+ * and no more requests are read or processed until the output is drained. 
+ * A large download that uses up its budget yields to the other connections
+ * and resumes in the next loop iteration.
+ * Once everything is sent, the empty hsbuffers are returned to the pool.
+ */
+static void respond_conn(struct hsevent *event) {
+  int result = flush_conn(event);
+  while (result == 1 && hsbuffer_readable(event->inbound)) {
+    if (create_response(event) == HSPARSE_INCOMPLETE) {
+      break;
+    }
+    result = flush_conn(event);
+  }
+
+  if (result == 2) {
+    /* The socket is still writable, only the pending list resumes the send */
+    if (event->events & EPOLLOUT) {
+      hsevent_update(event, event->events & ~EPOLLOUT);
+    }
+    hsevent_activate(event, EPOLLOUT);
+    return ;
+  }
+  if (result == 0) {
+    if (!(event->events & EPOLLOUT)) {
+      hsevent_update(event, event->events | EPOLLOUT);
+    }
+    return ;
+  }
+  if (event->events & EPOLLOUT) {
+    hsevent_update(event, event->events & ~EPOLLOUT);
+  }
+  if (result < 0) {
+    close_event(event);
+    return ;
+  }
+  if (event->unread) {
+    /* Reading was stopped while the output was blocked, the requests left in the socket come first */
+    event->unread = 0;
+    hsevent_activate(event, EPOLLIN);
+    return ;
+  }
+  if (event->closed) {
+    close_event(event);
+    return ;
+  }
+  /* The connection is idle until the next request arrives */
+  hsbuffer_release(event->inbound);
+  hsbuffer_release(event->outbound);
+}
+
 void accept_conn(struct hsevent *event) {
   int conn_sockfd;
   while (1) {
     socklen_t socklen = sizeof(struct sockaddr_in);
-    conn_sockfd = accept(event->sockfd, (struct sockaddr*)event->remote, &socklen);
+    conn_sockfd = hsevent_accept(event, (struct sockaddr*)event->remote, &socklen);
     if (conn_sockfd < 0) {
       if (errno == EAGAIN) {
         break;
@@ -54,38 +121,37 @@ void accept_conn(struct hsevent *event) {
       }
     } else {
       set_nonblocking(conn_sockfd);
+      if (send_mode == HSOUTQ_LATENCY) {
+        set_nodelay(conn_sockfd);
+      }
       struct hsevent *new_event = hsevent_init(conn_sockfd, EPOLLIN | EPOLLET | EPOLLRDHUP, event->event_base);
       hsevent_update_cb(new_event, HSEVENT_RDHUP, rdhup_conn);
       hsevent_update_cb(new_event, HSEVENT_READ, read_conn);
       hsevent_update_cb(new_event, HSEVENT_WRITE, write_conn);
+      hsevent_update_cb(new_event, HSEVENT_TIMEOUT, timeout_conn);
+      hsevent_update_timer(new_event, idle_timeout);
     }
   }
 }
 
 void rdhup_conn(struct hsevent *event) {
-  outbound_send(event);
-  close_event(event);
+  /* The peer has finished sending, answer what is left in the socket before closing */
+  event->closed = 1;
+  read_conn(event);
 }
 
-void read_conn(struct hsevent *event) {
-  uint64_t timerfd_buf;
-  if (read(event->timerfd, &timerfd_buf, sizeof(uint64_t)) < 0) {
-    if (errno == EAGAIN) {
-      struct itimerspec timeout;
-      timeout.it_value.tv_nsec = 0;
-      timeout.it_value.tv_sec = HSINTERVAL;
-      timeout.it_interval.tv_nsec = 0;
-      timeout.it_interval.tv_sec = HSINTERVAL;
-      timerfd_settime(event->timerfd, 0, &timeout, NULL);
-    } else {
-      perror("timerfd");
-    }
-  } else {
+void timeout_conn(struct hsevent *event) {
+  /* A 408 can not follow a response that is still being sent, the connection is just closed */
+  if (hsoutq_pending(event->outq) == 0) {
     response_timeout(event);
-    outbound_send(event);
-    close_event(event);
-    return;
+    flush_conn(event);
   }
+  close_event(event);
+}
+
+void read_conn(struct hsevent *event) {
+  hsevent_update_timer(event, idle_timeout);
+  int blocked = output_blocked(event);
 
   if (event->pipe_rfd != -1) {
     while (1) {
@@ -93,8 +159,7 @@ void read_conn(struct hsevent *event) {
       ssize_t bytes_read = read(event->pipe_rfd, buf, 512);
       if (bytes_read < 0) {
         if (errno == EAGAIN) {
-          event->closed = 1;
-          break;
+          break;  // The script is still running, e.g. reading the rest of the body
         } else {
           perror("recv()");
           break;
@@ -104,45 +169,53 @@ void read_conn(struct hsevent *event) {
         event->closed = 1;
         break;
       } else {
-        hsbuffer_ncpy(event->outbound, buf, bytes_read + 1);
+        hsoutq_add_copy(event->outq, buf, (size_t)bytes_read);
       }
     }
   }
 
+  if (blocked) {
+    /* A client that does not read its responses can not make inbound grow, respond_conn() reads later */
+    event->unread = 1;
+    return ;
+  }
+
+  size_t total_read = 0;
   while (1) {
-    size_t remain = hsbuffer_remain(event->inbound);
-    if (remain == 0) {
-      hsbuffer_expand(event->inbound, hsbuffer_capacity(event->inbound) * 2);
+    if (total_read >= HSEVENT_BUDGET) {
+      /* respond_conn() leaves the rest to the next loop iteration, or to write_conn() if output is queued */
+      event->unread = 1;
+      break;
     }
-    ssize_t bytes_read = hsbuffer_recv(event->sockfd, event->inbound, hsbuffer_remain(event->inbound));
-    if (bytes_read < 0) {
-      if (errno == EAGAIN) {
+    if (hsbuffer_remain(event->inbound) == 0) {
+      hsbuffer_compact(event->inbound);
+    }
+    if (hsbuffer_remain(event->inbound) == 0) {
+      size_t capacity = hsbuffer_capacity(event->inbound);
+      if (capacity >= HSEVENT_INBOUND_MAX) {
+        event->unread = 1;  // Read again once the requests in inbound are answered
         break;
-      } else {
+      }
+      hsbuffer_expand(event->inbound, MIN(capacity * 2, HSEVENT_INBOUND_MAX));
+    }
+    ssize_t bytes_read = hsevent_recv(event, hsbuffer_remain(event->inbound));
+    if (bytes_read == 0) {
+      event->closed = 1;  // The peer will not send more requests
+      break;
+    } else if (bytes_read < 0) {
+      if (errno != EAGAIN) {
         perror("recv() failed");
+        event->closed = 1;
       }
+      break;
     }
+    total_read += (size_t)bytes_read;
   }
-  hsevent_update(event, event->events | EPOLLOUT);
+
+  respond_conn(event);
 }
 
 void write_conn(struct hsevent *event) {
-  while (hsbuffer_readable(event->inbound)) {
-    int fd = -1;
-    size_t file_length = -1;
-    int result = create_response(event, &fd, &file_length);
-    if (result == HSPARSE_INCOMPLETE) {
-      break;
-    }
-    outbound_send(event);
-    if (fd > 0) {
-      sendfile(event->sockfd, fd, 0, file_length);
-      close(fd);
-    }
-  }
-
-  if (event->closed) {
-    outbound_send(event);
-    close_event(event);
-  }
+  response_cgi_body(event);
+  respond_conn(event);
 }
@@ -0,0 +1,353 @@
+/**
+ * @file filecache.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ */
+
+#include "filecache.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct hsfcache {
+  struct hsfile **buckets;   // Chained hash table of the cached files
+  size_t mask;               // Number of buckets - 1
+  int capacity;
+  int count;
+  uint64_t ttl;
+  size_t budget;             // Maximum of stats.memory
+  struct hsfile *lru_head;   // The most recently used file
+  struct hsfile *lru_tail;   // The least recently used file, evicted first
+  struct hsfcache_stats stats;
+};
+
+/**
+ * @brief FNV-1a
+ */
+static uint64_t hash_path(const char *path) {
+  uint64_t hash = 14695981039346656037ULL;
+  while (*path) {
+    hash ^= (unsigned char)*path++;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+struct hsfcache* hsfcache_init(int capacity, uint64_t ttl, size_t budget) {
+  struct hsfcache *cache = (struct hsfcache*)calloc(1, sizeof(struct hsfcache));
+  if (!cache) {
+    return NULL;
+  }
+  size_t num_of_buckets = 16;
+  while (num_of_buckets < (size_t)capacity * 2) {
+    num_of_buckets *= 2;
+  }
+  cache->buckets = (struct hsfile**)calloc(num_of_buckets, sizeof(struct hsfile*));
+  if (!cache->buckets) {
+    free(cache);
+    return NULL;
+  }
+  cache->mask = num_of_buckets - 1;
+  cache->capacity = capacity > 0 ? capacity : 1;
+  cache->ttl = ttl;
+  cache->budget = budget;
+  return cache;
+}
+
+/**
+ * @brief Derive the validators of the responses from the metadata of the file.
+ */
+static void file_validators(struct hsfile *file) {
+  unsigned long long mtime = (unsigned long long)file->st.st_mtim.tv_sec * 1000000000ULL + 
+                             (unsigned long long)file->st.st_mtim.tv_nsec;
+  snprintf(file->etag, sizeof(file->etag), "\"%llx-%llx-%llx\"", (unsigned long long)file->st.st_ino,
+           (unsigned long long)file->st.st_size, mtime);
+  struct tm tm;
+  gmtime_r(&file->st.st_mtime, &tm);
+  strftime(file->modified, sizeof(file->modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+static struct hsfile* file_open(const char *path, uint64_t now) {
+  /* Cached fds must not leak into CGI scripts */
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct hsfile *file = (struct hsfile*)calloc(1, sizeof(struct hsfile));
+  if (!file || !(file->path = strdup(path)) || fstat(fd, &file->st) < 0) {
+    if (file) {
+      free(file->path);
+    }
+    free(file);
+    close(fd);
+    return NULL;
+  }
+  file->fd = fd;
+  file_validators(file);
+  file->checked = now;
+  file->refs = 1;
+  return file;
+}
+
+void hsfile_put(struct hsfile *file) {
+  if (file && --file->refs == 0) {
+    if (file->fd >= 0) {
+      close(file->fd);
+    }
+    hsfile_put(file->compressed);
+    free(file->data);
+    free(file->headers);
+    free(file->path);
+    free(file);
+  }
+}
+
+static void lru_unlink(struct hsfcache *cache, struct hsfile *file) {
+  if (file->lru_prev) {
+    file->lru_prev->lru_next = file->lru_next;
+  } else {
+    cache->lru_head = file->lru_next;
+  }
+  if (file->lru_next) {
+    file->lru_next->lru_prev = file->lru_prev;
+  } else {
+    cache->lru_tail = file->lru_prev;
+  }
+  file->lru_prev = file->lru_next = NULL;
+}
+
+static void lru_push(struct hsfcache *cache, struct hsfile *file) {
+  file->lru_next = cache->lru_head;
+  if (cache->lru_head) {
+    cache->lru_head->lru_prev = file;
+  } else {
+    cache->lru_tail = file;
+  }
+  cache->lru_head = file;
+}
+
+static size_t memory_size(const struct hsfile *file) {
+  size_t size = file->data ? (size_t)file->st.st_size + file->headers_length : 0;
+  return file->compressed ? size + (size_t)file->compressed->st.st_size : size;
+}
+
+/**
+ * @brief Free the compressed copy of a file, and its contents unless some response is sending them.
+ * 
+ * @note
+ * A response still sending the compressed copy holds a reference to it.
+ */
+static void memory_release(struct hsfcache *cache, struct hsfile *file) {
+  if (file->data && file->refs == 1) {
+    cache->stats.memory -= (size_t)file->st.st_size + file->headers_length;
+    free(file->data);
+    free(file->headers);
+    file->data = file->headers = NULL;
+    file->headers_length = 0;
+  }
+  if (file->compressed) {
+    cache->stats.memory -= (size_t)file->compressed->st.st_size;
+    hsfile_put(file->compressed);
+    file->compressed = NULL;
+  }
+  file->compress_tried = 0;
+}
+
+/**
+ * @brief Release the least recently used contents until size more bytes fit in the budget.
+ * 
+ * @return 0 on success, or -1 if they do not fit.
+ */
+static int memory_reserve(struct hsfcache *cache, struct hsfile *file, size_t size) {
+  if (size > cache->budget) {
+    return -1;
+  }
+  for (struct hsfile *victim = cache->lru_tail; victim && cache->stats.memory + size > cache->budget; 
+       victim = victim->lru_prev) {
+    if (victim != file) {
+      memory_release(cache, victim);
+    }
+  }
+  return cache->stats.memory + size > cache->budget ? -1 : 0;
+}
+
+/**
+ * @brief Read a small file into memory, releasing the least recently used contents to make room.
+ */
+static void memory_load(struct hsfcache *cache, struct hsfile *file) {
+  size_t size = (size_t)file->st.st_size;
+  if (size == 0 || size > HSFCACHE_SMALL || memory_reserve(cache, file, size) < 0) {
+    return ;
+  }
+  file->data = (char*)malloc(size);
+  if (!file->data) {
+    return ;
+  }
+  if (pread(file->fd, file->data, size, 0) != (ssize_t)size) {
+    free(file->data);
+    file->data = NULL;
+    return ;
+  }
+  cache->stats.memory += size;
+}
+
+int hsfcache_set_compressed(struct hsfcache *cache, struct hsfile *file, char *data, size_t length, 
+                            const char *tag) {
+  if (!cache || !file->cached || file->compressed) {
+    free(data);
+    return -1;
+  }
+  file->compress_tried = 1;
+  if (!data || memory_reserve(cache, file, length) < 0) {
+    free(data);
+    return -1;
+  }
+  struct hsfile *copy = (struct hsfile*)calloc(1, sizeof(struct hsfile));
+  if (!copy) {
+    free(data);
+    return -1;
+  }
+  copy->fd = -1;
+  copy->st = file->st;
+  copy->st.st_size = (off_t)length;
+  /* The entity tag differs from the one of file, the modification time does not */
+  size_t etag_length = strlen(file->etag);
+  snprintf(copy->etag, sizeof(copy->etag), "%.*s-%s\"", (int)(etag_length - 1), file->etag, tag);
+  memcpy(copy->modified, file->modified, sizeof(copy->modified));
+  copy->data = data;
+  copy->checked = file->checked;
+  copy->refs = 1;
+  file->compressed = copy;
+  cache->stats.memory += length;
+  return 0;
+}
+
+int hsfcache_set_headers(struct hsfcache *cache, struct hsfile *file, const char *headers, size_t length) {
+  if (!cache || !file->cached || !file->data || file->headers || memory_reserve(cache, file, length) < 0) {
+    return -1;
+  }
+  file->headers = (char*)malloc(length);
+  if (!file->headers) {
+    return -1;
+  }
+  memcpy(file->headers, headers, length);
+  file->headers_length = length;
+  cache->stats.memory += length;
+  return 0;
+}
+
+/**
+ * @brief Remove a file from the cache and drop the reference of the cache.
+ * 
+ * @note
+ * The contents of the file are no longer counted, but they are freed with the last reference.
+ */
+static void cache_remove(struct hsfcache *cache, struct hsfile *file) {
+  struct hsfile **link = &cache->buckets[hash_path(file->path) & cache->mask];
+  while (*link != file) {
+    link = &(*link)->hash_next;
+  }
+  *link = file->hash_next;
+  lru_unlink(cache, file);
+  file->cached = 0;
+  cache->count--;
+  cache->stats.memory -= memory_size(file);
+  hsfile_put(file);
+}
+
+static int same_file(const struct stat *a, const struct stat *b) {
+  return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_size == b->st_size &&
+         a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+struct hsfile* hsfcache_open(struct hsfcache *cache, const char *path, uint64_t now) {
+  if (!cache) {
+    return file_open(path, now);
+  }
+  size_t bucket = hash_path(path) & cache->mask;
+  struct hsfile *file = cache->buckets[bucket];
+  while (file && strcmp(file->path, path)) {
+    file = file->hash_next;
+  }
+  if (file) {
+    if (now - file->checked < cache->ttl) {
+      cache->stats.hits++;
+    } else {
+      /* Replaced, modified or deleted since it was opened */
+      struct stat st;
+      cache->stats.checks++;
+      if (stat(path, &st) < 0 || !same_file(&st, &file->st)) {
+        cache_remove(cache, file);
+        file = NULL;
+      } else {
+        file->checked = now;
+        file->missing = 0;
+      }
+    }
+  }
+  if (file) {
+    lru_unlink(cache, file);
+    lru_push(cache, file);
+    if (!file->data) {
+      /* The contents were released to make room, a hot file gets them back */
+      memory_load(cache, file);
+    }
+    file->refs++;
+    return file;
+  }
+
+  cache->stats.misses++;
+  file = file_open(path, now);
+  if (!file || !S_ISREG(file->st.st_mode)) {
+    return file;
+  }
+  if (cache->count == cache->capacity) {
+    cache_remove(cache, cache->lru_tail);
+  }
+  file->hash_next = cache->buckets[bucket];
+  cache->buckets[bucket] = file;
+  lru_push(cache, file);
+  file->cached = 1;
+  file->refs++;
+  cache->count++;
+  memory_load(cache, file);
+  return file;
+}
+
+struct hsfile* hsfcache_open_variant(struct hsfcache *cache, struct hsfile *file, int variant, 
+                                     const char *suffix, uint64_t now) {
+  if (file->missing & (1u << variant)) {
+    return NULL;
+  }
+  char path[512];
+  if (snprintf(path, 512, "%s%s", file->path, suffix) >= 512) {
+    return NULL;
+  }
+  struct hsfile *found = hsfcache_open(cache, path, now);
+  if (!found || !S_ISREG(found->st.st_mode)) {
+    hsfile_put(found);
+    file->missing |= 1u << variant;
+    return NULL;
+  }
+  return found;
+}
+
+void hsfcache_free(struct hsfcache *cache) {
+  if (!cache) {
+    return ;
+  }
+  while (cache->lru_head) {
+    cache_remove(cache, cache->lru_head);
+  }
+  free(cache->buckets);
+  free(cache);
+}
+
+struct hsfcache_stats hsfcache_stats(const struct hsfcache *cache) {
+  return cache->stats;
+}
@@ -0,0 +1,41 @@
+/**
+ * @file gzip.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ */
+
+#include "gzip.h"
+
+#include <stdlib.h>
+#include <zlib.h>
+
+size_t hsgzip_compress(const char *data, size_t length, char **result) {
+  z_stream stream;
+  stream.zalloc = Z_NULL;
+  stream.zfree = Z_NULL;
+  stream.opaque = Z_NULL;
+  /* 16 + 15 means a 32 KB window with a gzip header and trailer */
+  if (deflateInit2(&stream, HSGZIP_LEVEL, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return 0;
+  }
+  size_t bound = deflateBound(&stream, length);
+  char *output = (char*)malloc(bound);
+  if (!output) {
+    deflateEnd(&stream);
+    return 0;
+  }
+  stream.next_in = (Bytef*)data;
+  stream.avail_in = (uInt)length;
+  stream.next_out = (Bytef*)output;
+  stream.avail_out = (uInt)bound;
+  int ret = deflate(&stream, Z_FINISH);
+  size_t output_length = stream.total_out;
+  deflateEnd(&stream);
+  if (ret != Z_STREAM_END || output_length >= length) {
+    free(output);
+    return 0;
+  }
+  *result = output;
+  return output_length;
+}
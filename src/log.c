@@ -6,6 +6,7 @@
  */
 
 #include "log.h"
+#include "utils.h"
 
 #include <stdio.h>
 #include <fcntl.h>
@@ -29,7 +30,7 @@ int hslog_init(const char *logfile) {
   return logfd;
 }
 
-void hslog_log(struct sockaddr_in *remote, Request *request, int status, int length) {
+void hslog_log(struct sockaddr_in *remote, const struct hsrequest *request, int status, int length) {
   if (logfd < 0) {
     return ;
   }
@@ -57,13 +58,15 @@ void hslog_log(struct sockaddr_in *remote, Request *request, int status, int len
 
   /* Log the request line */
   if (request) {
-    size_t total_line = 5 + strlen(request->http_method) + strlen(request->http_uri) + strlen(request->http_version); 
-    snprintf(logbuf + used_length, total_line + 1,
-                                   " \"%s %s %s\"",
-                                   request->http_method,
-                                   request->http_uri,
-                                   request->http_version);
-    used_length += total_line;
+    used_length += snprintf(logbuf + used_length, 1024 - 32 - used_length,
+                                                  " \"%.*s %.*s %.*s\"",
+                                                  (int)request->method.length,
+                                                  hsrequest_ptr(request, request->method),
+                                                  (int)request->uri.length,
+                                                  hsrequest_ptr(request, request->uri),
+                                                  (int)request->version.length,
+                                                  hsrequest_ptr(request, request->version));
+    used_length = MIN(used_length, 1024 - 33);
   }
 
   /* Log status code and length of content */
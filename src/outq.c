@@ -0,0 +1,378 @@
+/**
+ * @file outq.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ */
+
+#include "outq.h"
+#include "utils.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#define HSOUTQ_BUFFER 0   // Bytes of the bound hsbuffer
+#define HSOUTQ_STATIC 1   // A string that is not freed by the queue, or that is owned by file
+#define HSOUTQ_OWNED  2   // A block allocated from the pool
+#define HSOUTQ_FILE   3   // A range of a file
+
+struct hsoutq_seg {
+  int type;
+  const char *data;           // Next byte to send of a STATIC or OWNED segment
+  char *block;                // The block of an OWNED segment
+  size_t block_size;          // Size of block
+  int fd;                     // The file of a FILE segment
+  struct hsfile *file;        // The cached file that owns fd or data, NULL means fd is owned by the segment
+  off_t offset;               // Next byte to send of fd
+  size_t length;              // Bytes left to send
+  struct hsoutq_seg *next;
+};
+
+struct hsoutq {
+  struct hspool *pool;
+  struct hsbuffer *buffer;    // The bound hsbuffer
+  size_t buffer_queued;       // Readable bytes of buffer that are already in the chain
+  struct hsoutq_seg *head;
+  struct hsoutq_seg *tail;
+  size_t pending;             // Bytes left to send in the chain
+  int mode;                   // HSOUTQ_LATENCY or HSOUTQ_THROUGHPUT
+};
+
+struct hsoutq* hsoutq_init(struct hspool *pool, struct hsbuffer *buffer) {
+  struct hsoutq *queue = (struct hsoutq*)hspool_alloc(pool, sizeof(struct hsoutq));
+  if (!queue) {
+    return NULL;
+  }
+  queue->pool = pool;
+  queue->buffer = buffer;
+  queue->buffer_queued = 0;
+  queue->head = queue->tail = NULL;
+  queue->pending = 0;
+  queue->mode = HSOUTQ_LATENCY;
+  return queue;
+}
+
+void hsoutq_set_mode(struct hsoutq *queue, int mode) {
+  queue->mode = mode;
+}
+
+static void seg_free(struct hsoutq *queue, struct hsoutq_seg *seg) {
+  if (seg->type == HSOUTQ_OWNED) {
+    hspool_put(queue->pool, seg->block, seg->block_size);
+  } else if (seg->file) {
+    hsfile_put(seg->file);
+  } else if (seg->type == HSOUTQ_FILE) {
+    close(seg->fd);
+  }
+  hspool_put(queue->pool, seg, sizeof(struct hsoutq_seg));
+}
+
+void hsoutq_free(struct hsoutq *queue) {
+  if (!queue) {
+    return ;
+  }
+  struct hsoutq_seg *seg = queue->head;
+  while (seg) {
+    struct hsoutq_seg *next = seg->next;
+    seg_free(queue, seg);
+    seg = next;
+  }
+  hspool_put(queue->pool, queue, sizeof(struct hsoutq));
+}
+
+static struct hsoutq_seg* seg_append(struct hsoutq *queue, int type, size_t length) {
+  struct hsoutq_seg *seg = (struct hsoutq_seg*)hspool_alloc(queue->pool, sizeof(struct hsoutq_seg));
+  if (!seg) {
+    return NULL;
+  }
+  seg->type = type;
+  seg->data = NULL;
+  seg->block = NULL;
+  seg->block_size = 0;
+  seg->fd = -1;
+  seg->file = NULL;
+  seg->offset = 0;
+  seg->length = length;
+  seg->next = NULL;
+  if (queue->tail) {
+    queue->tail->next = seg;
+  } else {
+    queue->head = seg;
+  }
+  queue->tail = seg;
+  queue->pending += length;
+  return seg;
+}
+
+int hsoutq_add_buffer(struct hsoutq *queue) {
+  size_t readable = hsbuffer_readable(queue->buffer);
+  if (readable <= queue->buffer_queued) {
+    return 0;
+  }
+  size_t length = readable - queue->buffer_queued;
+  if (queue->tail && queue->tail->type == HSOUTQ_BUFFER) {
+    queue->tail->length += length;
+    queue->pending += length;
+  } else if (!seg_append(queue, HSOUTQ_BUFFER, length)) {
+    return -1;
+  }
+  queue->buffer_queued = readable;
+  return 0;
+}
+
+int hsoutq_add_static(struct hsoutq *queue, const char *data, size_t length) {
+  if (hsoutq_add_buffer(queue) < 0) {
+    return -1;
+  }
+  if (length == 0) {
+    return 0;
+  }
+  struct hsoutq_seg *seg = seg_append(queue, HSOUTQ_STATIC, length);
+  if (!seg) {
+    return -1;
+  }
+  seg->data = data;
+  return 0;
+}
+
+int hsoutq_add_copy(struct hsoutq *queue, const char *data, size_t length) {
+  if (hsoutq_add_buffer(queue) < 0) {
+    return -1;
+  }
+  if (length == 0) {
+    return 0;
+  }
+  char *block = (char*)hspool_alloc(queue->pool, length);
+  if (!block) {
+    return -1;
+  }
+  struct hsoutq_seg *seg = seg_append(queue, HSOUTQ_OWNED, length);
+  if (!seg) {
+    hspool_put(queue->pool, block, length);
+    return -1;
+  }
+  memcpy(block, data, length);
+  seg->data = seg->block = block;
+  seg->block_size = length;
+  return 0;
+}
+
+/**
+ * @return 0 if the file has been read into an owned segment, otherwise -1.
+ */
+static int add_inline_file(struct hsoutq *queue, int fd, off_t offset, size_t length) {
+  char *block = (char*)hspool_alloc(queue->pool, length);
+  if (!block) {
+    return -1;
+  }
+  if (pread(fd, block, length, offset) != (ssize_t)length) {
+    hspool_put(queue->pool, block, length);
+    return -1;
+  }
+  struct hsoutq_seg *seg = seg_append(queue, HSOUTQ_OWNED, length);
+  if (!seg) {
+    hspool_put(queue->pool, block, length);
+    return -1;
+  }
+  seg->data = seg->block = block;
+  seg->block_size = length;
+  return 0;
+}
+
+int hsoutq_add_file(struct hsoutq *queue, int fd, off_t offset, size_t length) {
+  if (hsoutq_add_buffer(queue) < 0) {
+    close(fd);
+    return -1;
+  }
+  if (length == 0) {
+    close(fd);
+    return 0;
+  }
+  if (length <= HSOUTQ_INLINE_FILE && add_inline_file(queue, fd, offset, length) == 0) {
+    close(fd);
+    return 0;
+  }
+  struct hsoutq_seg *seg = seg_append(queue, HSOUTQ_FILE, length);
+  if (!seg) {
+    close(fd);
+    return -1;
+  }
+  seg->fd = fd;
+  seg->offset = offset;
+  return 0;
+}
+
+int hsoutq_add_shared(struct hsoutq *queue, const char *data, size_t length, struct hsfile *file) {
+  if (hsoutq_add_buffer(queue) < 0) {
+    hsfile_put(file);
+    return -1;
+  }
+  if (length == 0) {
+    hsfile_put(file);
+    return 0;
+  }
+  struct hsoutq_seg *seg = seg_append(queue, HSOUTQ_STATIC, length);
+  if (!seg) {
+    hsfile_put(file);
+    return -1;
+  }
+  seg->data = data;
+  seg->file = file;
+  return 0;
+}
+
+int hsoutq_add_hsfile(struct hsoutq *queue, struct hsfile *file, off_t offset, size_t length) {
+  if (file->data) {
+    return hsoutq_add_shared(queue, file->data + offset, length, file);
+  }
+  if (hsoutq_add_buffer(queue) < 0) {
+    hsfile_put(file);
+    return -1;
+  }
+  if (length == 0) {
+    hsfile_put(file);
+    return 0;
+  }
+  if (length <= HSOUTQ_INLINE_FILE && add_inline_file(queue, file->fd, offset, length) == 0) {
+    hsfile_put(file);
+    return 0;
+  }
+  struct hsoutq_seg *seg = seg_append(queue, HSOUTQ_FILE, length);
+  if (!seg) {
+    hsfile_put(file);
+    return -1;
+  }
+  seg->fd = file->fd;
+  seg->file = file;
+  seg->offset = offset;
+  return 0;
+}
+
+/**
+ * @brief Remove bytes_sent bytes from the front of the chain.
+ */
+static void chain_consume(struct hsoutq *queue, size_t bytes_sent) {
+  queue->pending -= bytes_sent;
+  while (bytes_sent > 0) {
+    struct hsoutq_seg *seg = queue->head;
+    size_t length = MIN(seg->length, bytes_sent);
+    if (seg->type == HSOUTQ_BUFFER) {
+      hsbuffer_consume(queue->buffer, length);
+      queue->buffer_queued -= length;
+    } else if (seg->type == HSOUTQ_FILE) {
+      seg->offset += length;
+    } else {
+      seg->data += length;
+    }
+    seg->length -= length;
+    bytes_sent -= length;
+    if (seg->length == 0) {
+      queue->head = seg->next;
+      if (!queue->head) {
+        queue->tail = NULL;
+      }
+      seg_free(queue, seg);
+    }
+  }
+}
+
+/**
+ * @brief Send the memory segments in front of the first file segment.
+ *
+ * @return The number of bytes sent, or -1 if an error occured.
+ */
+static ssize_t send_memory(struct hsoutq *queue, int sockfd) {
+  struct iovec iov[HSOUTQ_IOV];
+  int iovcnt = 0;
+  int flags = MSG_NOSIGNAL;
+  size_t buffer_offset = 0;
+  char *buffer_data = NULL;
+  for (struct hsoutq_seg *seg = queue->head; seg && iovcnt < HSOUTQ_IOV; seg = seg->next) {
+    if (seg->type == HSOUTQ_FILE) {
+      flags |= MSG_MORE;  // The file follows immediately, don't send a short packet
+      break;
+    }
+    if (seg->type == HSOUTQ_BUFFER) {
+      if (!buffer_data) {
+        buffer_data = hsbuffer_pos(queue->buffer, READ_POS);
+      }
+      iov[iovcnt].iov_base = buffer_data + buffer_offset;
+      buffer_offset += seg->length;
+    } else {
+      iov[iovcnt].iov_base = (void*)seg->data;
+    }
+    iov[iovcnt].iov_len = seg->length;
+    iovcnt++;
+  }
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = iovcnt;
+  return sendmsg(sockfd, &msg, flags);
+}
+
+static void set_cork(int sockfd, int on) {
+  /* Fails harmlessly on sockets that are not TCP */
+  setsockopt(sockfd, IPPROTO_TCP, TCP_CORK, &on, sizeof(int));
+}
+
+static int flush_chain(struct hsoutq *queue, int sockfd, size_t budget) {
+  size_t total_sent = 0;
+  while (queue->head) {
+    if (budget && total_sent >= budget) {
+      return 2;
+    }
+    ssize_t bytes_sent;
+    if (queue->head->type == HSOUTQ_FILE) {
+      off_t offset = queue->head->offset;
+      size_t length = budget ? MIN(queue->head->length, budget - total_sent) : queue->head->length;
+      bytes_sent = sendfile(sockfd, queue->head->fd, &offset, length);
+      if (bytes_sent == 0) {
+        /* The file has been truncated, the rest of the response can not be sent */
+        return -1;
+      }
+    } else {
+      bytes_sent = send_memory(queue, sockfd);
+    }
+    if (bytes_sent < 0) {
+      if (errno == EAGAIN) {
+        return 0;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("hsoutq_flush() failed");
+      return -1;
+    }
+    chain_consume(queue, (size_t)bytes_sent);
+    total_sent += (size_t)bytes_sent;
+  }
+  return 1;
+}
+
+int hsoutq_flush(struct hsoutq *queue, int sockfd, size_t budget) {
+  if (hsoutq_add_buffer(queue) < 0) {
+    return -1;
+  }
+  int corked = queue->mode == HSOUTQ_THROUGHPUT && queue->head && queue->head != queue->tail;
+  if (corked) {
+    set_cork(sockfd, 1);
+  }
+  int result = flush_chain(queue, sockfd, budget);
+  if (corked) {
+    set_cork(sockfd, 0);
+  }
+  return result;
+}
+
+size_t hsoutq_pending(const struct hsoutq *queue) {
+  return queue->pending;
+}
@@ -1,15 +1,116 @@
 /**
- * @file buffer.c
+ * @file parse.c
  * @author Quan.Dashuai
  * @version 1.0
  * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
  */
 
 #include "parse.h"
+#include "request.h"
 
 #include <string.h>
+#include <strings.h>
+
+/**
+ * @brief Copy slice to the null-terminated string dst of capacity bytes, truncating it like the grammar does.
+ */
+static void slice_copy(char *dst, size_t capacity, const struct hsrequest *parsed, struct hsslice slice) {
+  size_t length = slice.length < capacity - 1 ? slice.length : capacity - 1;
+  memcpy(dst, hsrequest_ptr(parsed, slice), length);
+  dst[length] = '\0';
+}
+
+/**
+ * @brief Create an empty request in its own arena.
+ * 
+ * @param[in] fields_size The expected bytes of the URI and the header fields.
+ * @param[in] header_capacity The initial length of the header array.
+ * 
+ * @return A pointer to the request, or NULL if malloc() failed.
+ */
+static Request* request_create(size_t fields_size, int header_capacity) {
+  struct hsarena arena;
+  hsarena_init(&arena, sizeof(Request) + _Alignof(max_align_t) + 
+                       sizeof(Request_header) * header_capacity + fields_size);
+  Request *request = (Request*)hsarena_alloc(&arena, sizeof(Request));
+  Request_header *headers = (Request_header*)hsarena_alloc(&arena, sizeof(Request_header) * header_capacity);
+  if (!request || !headers) {
+    hsarena_free(&arena);
+    return NULL;
+  }
+  request->http_version[0] = '\0';
+  request->http_method[0] = '\0';
+  request->http_uri = NULL;
+  request->headers = headers;
+  request->header_count = 0;
+  request->header_capacity = header_capacity;
+  request->arena = arena;
+  return request;
+}
+
+int request_add_header(Request *request, const char *name, size_t name_length, 
+                       const char *value, size_t value_length) {
+  if (request->header_count == request->header_capacity) {
+    /* The old array stays in the arena until the request is freed */
+    int capacity = request->header_capacity * 2;
+    Request_header *headers = (Request_header*)hsarena_alloc(&request->arena, sizeof(Request_header) * capacity);
+    if (!headers) {
+      return -1;
+    }
+    memcpy(headers, request->headers, sizeof(Request_header) * request->header_count);
+    request->headers = headers;
+    request->header_capacity = capacity;
+  }
+  Request_header *header = &request->headers[request->header_count];
+  header->header_name = hsarena_strndup(&request->arena, name, name_length);
+  header->header_value = hsarena_strndup(&request->arena, value, value_length);
+  if (!header->header_name || !header->header_value) {
+    return -1;
+  }
+  header->name_length = name_length;
+  header->value_length = value_length;
+  request->header_count++;
+  return 0;
+}
 
 int parse(char *buffer, int *size, Request **request) {
+  struct hsrequest parsed;
+  *request = NULL;
+  int result = hsrequest_parse(&parsed, NULL, buffer, (size_t)*size);
+  if (result == HSPARSE_INCOMPLETE) {
+    *size = 0;
+    return result;
+  }
+  *size = (int)parsed.length;
+  if (result == HSPARSE_INVALID) {
+    return result;
+  }
+
+  /* The request headers are longer than the URI and the header fields together */
+  Request *copy = request_create(parsed.length, parsed.header_count < 4 ? 4 : parsed.header_count);
+  if (!copy) {
+    return HSPARSE_INVALID;
+  }
+  slice_copy(copy->http_method, sizeof(copy->http_method), &parsed, parsed.method);
+  slice_copy(copy->http_version, sizeof(copy->http_version), &parsed, parsed.version);
+  copy->http_uri = hsarena_strndup(&copy->arena, hsrequest_ptr(&parsed, parsed.uri), parsed.uri.length);
+  if (!copy->http_uri) {
+    parse_free(copy);
+    return HSPARSE_INVALID;
+  }
+  for (int i = 0; i < parsed.header_count; i++) {
+    const struct hsrequest_header *header = &parsed.headers[i];
+    if (request_add_header(copy, hsrequest_ptr(&parsed, header->name), header->name.length, 
+                           hsrequest_ptr(&parsed, header->value), header->value.length) < 0) {
+      parse_free(copy);
+      return HSPARSE_INVALID;
+    }
+  }
+  *request = copy;
+  return HSPARSE_VALID;
+}
+
+int parse_yacc(char *buffer, int *size, Request **request) {
   // Differant states in the state machine
 	enum {
 		STATE_START = 0, STATE_CR, STATE_CRLF, STATE_CRLFCR, STATE_CRLFCRLF
@@ -53,18 +154,19 @@ int parse(char *buffer, int *size, Request **request) {
 	}
 
 	if (state == STATE_CRLFCRLF) {
-		*request = (Request *) malloc(sizeof(Request));
-    (*request)->header_count = 0;
-		(*request)->header_capacity = 4;
-    (*request)->headers = (Request_header *)malloc(sizeof(Request_header) * 4);
+		*size = i;
+		*request = request_create(i, 4);
+		if (!*request) {
+			return HSPARSE_INVALID;
+		}
 		set_parsing_options(buf, i, *request);
 
-		*size = i;
 		if (yyparse() == HSPARSE_VALID) {
       return HSPARSE_VALID;
 		} else {
-      free((*request)->headers);
-      free(*request);
+      /* The scanner still holds the rest of this request */
+      yyrestart(NULL);
+      parse_free(*request);
       *request = NULL;
       return HSPARSE_INVALID;
     }
@@ -75,7 +177,7 @@ int parse(char *buffer, int *size, Request **request) {
 
 Request_header* find_key(Request *request, const char *key) {
 	for (int i = 0; request && i < request->header_count; i++) {
-		if (!strcmp(request->headers[i].header_name, key)) {
+		if (!strcasecmp(request->headers[i].header_name, key)) {
 			return &request->headers[i];
 		}
 	}
@@ -86,8 +188,7 @@ void parse_free(Request *request) {
 	if (!request) {
 		return ;
 	}
-	if (request->headers) {
-		free(request->headers);
-	}
-	free(request);
+	/* The request is allocated from its own arena */
+	struct hsarena arena = request->arena;
+	hsarena_free(&arena);
 }
@@ -0,0 +1,58 @@
+/**
+ * @file poller_epoll.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ */
+
+#include "poller.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+struct hspoller {
+  int epollfd;
+};
+
+struct hspoller* hspoller_init() {
+  struct hspoller *poller = (struct hspoller*)malloc(sizeof(struct hspoller));
+  if (!poller) {
+    return NULL;
+  }
+  poller->epollfd = epoll_create1(0);
+  if (poller->epollfd < 0) {
+    free(poller);
+    return NULL;
+  }
+  return poller;
+}
+
+void hspoller_free(struct hspoller *poller) {
+  close(poller->epollfd);
+  free(poller);
+}
+
+int hspoller_ctl(struct hspoller *poller, int op, int fd, uint32_t events, uint64_t data) {
+  struct epoll_event ev;
+  ev.events = events;
+  ev.data.u64 = data;
+  return epoll_ctl(poller->epollfd, op, fd, &ev);
+}
+
+int hspoller_wait(struct hspoller *poller, struct epoll_event *events, int max_events, int timeout) {
+  return epoll_wait(poller->epollfd, events, max_events, timeout);
+}
+
+int hspoller_accept(struct hspoller *poller, int fd, struct sockaddr *addr, socklen_t *addrlen) {
+  (void)poller;
+  return accept(fd, addr, addrlen);
+}
+
+ssize_t hspoller_recv(struct hspoller *poller, int fd, void *buf, size_t length) {
+  (void)poller;
+  return recv(fd, buf, length, 0);
+}
+
+const char* hspoller_name() {
+  return "epoll";
+}
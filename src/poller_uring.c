@@ -0,0 +1,716 @@
+/**
+ * @file poller_uring.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ *
+ * @details
+ * Every monitored fd starts with one IORING_OP_POLL_ADD request,
+ * which is multishot for edge-triggered registrations.
+ *
+ * The first hspoller_accept() on a fd replaces the polling of EPOLLIN
+ * with a multishot IORING_OP_ACCEPT, whose completions queue the accepted fds.
+ * The first hspoller_recv() on a fd replaces it with a multishot IORING_OP_RECV,
+ * which picks buffers from a buffer ring registered with the kernel,
+ * its completions queue the filled buffers until hspoller_recv() copies them out and gives them back.
+ * Both completions are reported as EPOLLIN, so the callbacks keep their loops that stop at EAGAIN,
+ * and the end of the stream is reported as EPOLLRDHUP. Only the other events are still polled.
+ *
+ * Once the queue is empty and the request has terminated, e.g. the buffer ring has run out,
+ * or the request has been cancelled because HSURING_RECV_MAX bytes are queued,
+ * hspoller_accept() and hspoller_recv() call accept() and recv() directly,
+ * and arm the request again when they return EAGAIN.
+ *
+ * The user_data of a request is (generation << 32 | kind << 30 | fd),
+ * the generation of a kind is increased whenever that request of fd is replaced,
+ * so the completions of a stale request are dropped.
+ *
+ * Requests are only queued by the functions of this file,
+ * they are submitted by the io_uring_enter() that waits for completions.
+ */
+
+#include "poller.h"
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#define HSURING_ENTRIES 1024          // Entries of the submission queue
+#define HSURING_IGNORE  UINT64_MAX    // user_data of requests whose completion is ignored
+#define HSURING_FD_MASK 0x3fffffff    // fd bits of user_data, the kind of request is above them
+#define HSURING_BUFFERS 1024          // Buffers of the buffer ring, a power of 2
+#define HSURING_BUFFER_SIZE 4096      // Bytes of one buffer
+#define HSURING_GROUP 0               // Buffer group of the buffer ring
+#define HSURING_RECV_MAX (16 * HSURING_BUFFER_SIZE) // Bytes queued on a fd before its recv request is cancelled
+
+/* Kinds of requests */
+#define HSURING_POLL   0
+#define HSURING_ACCEPT 1
+#define HSURING_RECV   2
+#define HSURING_KINDS  3
+
+struct hsuring_fd {
+  uint32_t generations[HSURING_KINDS]; // Generation of the current request of each kind
+  uint32_t events;      // Events of interest
+  uint64_t data;        // Reported with the ready events
+  int active;           // Whether the fd is monitored
+  int mode;             // HSURING_POLL, or the kind of request that reports EPOLLIN instead
+  int polling;          // Whether a poll request is armed
+  int armed;            // Whether the accept or recv request has not terminated
+  int cancelled;        // Whether the armed request is being cancelled
+  int head;             // First queued accepted fd or buffer id, -1 if empty
+  int tail;             // Last queued accepted fd or buffer id, -1 if empty
+  int next;             // Next accepted fd in the queue of the listening fd
+  size_t offset;        // Bytes of the head buffer that have been copied out
+  size_t queued;        // Bytes in the queued buffers
+  uint32_t reported;    // The hspoller_wait() that reported fd last time
+  int index;            // The ready event of fd in that hspoller_wait()
+};
+
+struct hsuring_buffer {
+  uint32_t length;      // Bytes received into the buffer
+  int next;             // Next queued buffer of the same fd, -1 if none
+};
+
+struct hspoller {
+  int ringfd;
+
+  /* Submission queue */
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned sq_mask;
+  unsigned sq_entries;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+
+  /* Completion queue */
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+
+  /* Mappings */
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring;
+  size_t cq_ring_size;
+  size_t sqes_size;
+
+  /* Buffer ring */
+  struct io_uring_buf_ring *buf_ring;
+  char *buf_data;                   // HSURING_BUFFERS buffers of HSURING_BUFFER_SIZE bytes
+  struct hsuring_buffer *buffers;   // Indexed by buffer id
+  uint16_t buf_tail;
+
+  int multishot_accept;   // 0 if the kernel does not support multishot accept
+  int multishot_recv;     // 0 if the buffer ring can not be registered, or multishot recv is not supported
+  uint32_t serial;        // Increased by every hspoller_wait()
+
+  struct hsuring_fd *fds; // Registrations indexed by fd, grows on demand
+  int num_of_fds;
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params *params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(struct hspoller *poller, unsigned min_complete, int timeout) {
+  unsigned to_submit = *poller->sq_tail - __atomic_load_n(poller->sq_head, __ATOMIC_ACQUIRE);
+  unsigned flags = 0;
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  memset(&arg, 0, sizeof(arg));
+  if (min_complete) {
+    flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    if (timeout >= 0) {
+      ts.tv_sec = timeout / 1000;
+      ts.tv_nsec = (long long)(timeout % 1000) * 1000000;
+      arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+  } else if (!to_submit) {
+    return 0;
+  }
+  int ret = (int)syscall(__NR_io_uring_enter, poller->ringfd, to_submit, min_complete,
+                         flags, min_complete ? &arg : NULL, min_complete ? sizeof(arg) : 0);
+  if (ret < 0 && (errno == ETIME || errno == EINTR)) {
+    return 0;
+  }
+  return ret;
+}
+
+static struct io_uring_sqe* uring_get_sqe(struct hspoller *poller) {
+  unsigned tail = *poller->sq_tail;
+  if (tail - __atomic_load_n(poller->sq_head, __ATOMIC_ACQUIRE) == poller->sq_entries) {
+    /* The submission queue is full, submit without waiting */
+    if (uring_enter(poller, 0, 0) < 0) {
+      return NULL;
+    }
+  }
+  unsigned index = tail & poller->sq_mask;
+  struct io_uring_sqe *sqe = &poller->sqes[index];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  poller->sq_array[index] = index;
+  __atomic_store_n(poller->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  return sqe;
+}
+
+static uint64_t uring_user_data(struct hspoller *poller, int fd, int kind) {
+  return ((uint64_t)poller->fds[fd].generations[kind] << 32) | ((uint64_t)kind << 30) | (uint32_t)fd;
+}
+
+/**
+ * @brief The events that are still polled, an accept or recv request reports EPOLLIN and EPOLLRDHUP.
+ */
+static uint32_t uring_poll_events(struct hsuring_fd *state) {
+  if (state->mode == HSURING_POLL) {
+    return state->events;
+  }
+  return state->events & ~(EPOLLIN | EPOLLRDHUP);
+}
+
+static int uring_poll_add(struct hspoller *poller, int fd) {
+  uint32_t events = uring_poll_events(&poller->fds[fd]);
+  if (poller->fds[fd].mode != HSURING_POLL && !(events & ~(EPOLLET | EPOLLONESHOT))) {
+    poller->fds[fd].polling = 0;  // Nothing is left to poll
+    return 0;
+  }
+  struct io_uring_sqe *sqe = uring_get_sqe(poller);
+  if (!sqe) {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = events & ~(EPOLLET | EPOLLONESHOT);
+  /* A one-shot request re-armed after every completion behaves like level-triggered epoll */
+  sqe->len = (events & EPOLLET) ? IORING_POLL_ADD_MULTI : 0;
+  sqe->user_data = uring_user_data(poller, fd, HSURING_POLL);
+  poller->fds[fd].polling = 1;
+  return 0;
+}
+
+/**
+ * @brief Cancel the request whose user_data is target, its completion is ignored.
+ */
+static int uring_cancel(struct hspoller *poller, uint8_t opcode, uint64_t target) {
+  struct io_uring_sqe *sqe = uring_get_sqe(poller);
+  if (!sqe) {
+    return -1;
+  }
+  sqe->opcode = opcode;
+  sqe->fd = -1;
+  sqe->addr = target;
+  sqe->user_data = HSURING_IGNORE;
+  return 0;
+}
+
+static void uring_poll_remove(struct hspoller *poller, int fd) {
+  if (poller->fds[fd].polling) {
+    uring_cancel(poller, IORING_OP_POLL_REMOVE, uring_user_data(poller, fd, HSURING_POLL));
+    poller->fds[fd].polling = 0;
+  }
+  poller->fds[fd].generations[HSURING_POLL]++;
+}
+
+/**
+ * @brief Arm the multishot accept or recv request of fd.
+ */
+static int uring_arm(struct hspoller *poller, int fd) {
+  struct hsuring_fd *state = &poller->fds[fd];
+  struct io_uring_sqe *sqe = uring_get_sqe(poller);
+  if (!sqe) {
+    return -1;
+  }
+  sqe->fd = fd;
+  if (state->mode == HSURING_ACCEPT) {
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  } else {
+    sqe->opcode = IORING_OP_RECV;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = HSURING_GROUP;
+  }
+  sqe->user_data = uring_user_data(poller, fd, state->mode);
+  state->armed = 1;
+  state->cancelled = 0;
+  return 0;
+}
+
+/**
+ * @brief Let the accept or recv request of mode report EPOLLIN of fd instead of the poll request.
+ */
+static int uring_switch(struct hspoller *poller, int fd, int mode) {
+  uring_poll_remove(poller, fd);
+  poller->fds[fd].mode = mode;
+  return uring_poll_add(poller, fd);
+}
+
+static void uring_give_back(struct hspoller *poller, int bid) {
+  struct io_uring_buf *buf = &poller->buf_ring->bufs[poller->buf_tail & (HSURING_BUFFERS - 1)];
+  buf->addr = (uint64_t)(uintptr_t)(poller->buf_data + (size_t)bid * HSURING_BUFFER_SIZE);
+  buf->len = HSURING_BUFFER_SIZE;
+  buf->bid = (uint16_t)bid;
+  poller->buf_tail++;
+  __atomic_store_n(&poller->buf_ring->tail, poller->buf_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Close the accepted fds, or give back the buffers, queued on fd.
+ */
+static void uring_drop_queue(struct hspoller *poller, int fd) {
+  struct hsuring_fd *state = &poller->fds[fd];
+  while (state->head >= 0) {
+    int item = state->head;
+    if (state->mode == HSURING_ACCEPT) {
+      state->head = poller->fds[item].next;
+      close(item);
+    } else {
+      state->head = poller->buffers[item].next;
+      uring_give_back(poller, item);
+    }
+  }
+  state->tail = -1;
+  state->offset = 0;
+  state->queued = 0;
+}
+
+/**
+ * @brief Release what a completion of a stale request carries.
+ */
+static void uring_drop_completion(struct hspoller *poller, int kind, struct io_uring_cqe *cqe) {
+  if (kind == HSURING_ACCEPT && cqe->res >= 0) {
+    close(cqe->res);
+  } else if (kind == HSURING_RECV && (cqe->flags & IORING_CQE_F_BUFFER)) {
+    uring_give_back(poller, (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+  }
+}
+
+static int uring_reserve(struct hspoller *poller, int fd) {
+  if (fd < poller->num_of_fds) {
+    return 0;
+  }
+  int num_of_fds = poller->num_of_fds ? poller->num_of_fds : 1024;
+  while (num_of_fds <= fd) {
+    num_of_fds *= 2;
+  }
+  struct hsuring_fd *fds = (struct hsuring_fd*)realloc(poller->fds, num_of_fds * sizeof(struct hsuring_fd));
+  if (!fds) {
+    return -1;
+  }
+  memset(fds + poller->num_of_fds, 0, (num_of_fds - poller->num_of_fds) * sizeof(struct hsuring_fd));
+  for (int i = poller->num_of_fds; i < num_of_fds; i++) {
+    fds[i].head = fds[i].tail = fds[i].next = -1;
+  }
+  poller->fds = fds;
+  poller->num_of_fds = num_of_fds;
+  return 0;
+}
+
+/**
+ * @brief Register the buffer ring that multishot recv requests pick buffers from.
+ *
+ * @return 0 on success, or -1 if the kernel does not support buffer rings.
+ */
+static int uring_setup_buffers(struct hspoller *poller) {
+  size_t ring_size = HSURING_BUFFERS * sizeof(struct io_uring_buf);
+  size_t data_size = (size_t)HSURING_BUFFERS * HSURING_BUFFER_SIZE;
+  void *ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  void *data = mmap(NULL, data_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  poller->buffers = (struct hsuring_buffer*)calloc(HSURING_BUFFERS, sizeof(struct hsuring_buffer));
+  if (ring == MAP_FAILED || data == MAP_FAILED || !poller->buffers) {
+    goto failed;
+  }
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)(uintptr_t)ring;
+  reg.ring_entries = HSURING_BUFFERS;
+  reg.bgid = HSURING_GROUP;
+  if (syscall(__NR_io_uring_register, poller->ringfd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    goto failed;
+  }
+  poller->buf_ring = (struct io_uring_buf_ring*)ring;
+  poller->buf_data = (char*)data;
+  poller->buf_tail = 0;
+  for (int bid = 0; bid < HSURING_BUFFERS; bid++) {
+    uring_give_back(poller, bid);
+  }
+  return 0;
+
+failed:
+  if (ring != MAP_FAILED) {
+    munmap(ring, ring_size);
+  }
+  if (data != MAP_FAILED) {
+    munmap(data, data_size);
+  }
+  free(poller->buffers);
+  poller->buffers = NULL;
+  return -1;
+}
+
+struct hspoller* hspoller_init() {
+  struct hspoller *poller = (struct hspoller*)calloc(1, sizeof(struct hspoller));
+  if (!poller) {
+    return NULL;
+  }
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = HSURING_ENTRIES * 4;
+  poller->ringfd = uring_setup(HSURING_ENTRIES, &params);
+  if (poller->ringfd < 0) {
+    free(poller);
+    return NULL;
+  }
+  if (!(params.features & IORING_FEAT_EXT_ARG)) {
+    close(poller->ringfd);
+    free(poller);
+    return NULL;
+  }
+
+  poller->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  poller->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (poller->cq_ring_size > poller->sq_ring_size) {
+      poller->sq_ring_size = poller->cq_ring_size;
+    }
+    poller->cq_ring_size = poller->sq_ring_size;
+  }
+  poller->sq_ring = mmap(NULL, poller->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, poller->ringfd, IORING_OFF_SQ_RING);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    poller->cq_ring = poller->sq_ring;
+  } else {
+    poller->cq_ring = mmap(NULL, poller->cq_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, poller->ringfd, IORING_OFF_CQ_RING);
+  }
+  poller->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  poller->sqes = (struct io_uring_sqe*)mmap(NULL, poller->sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, poller->ringfd, IORING_OFF_SQES);
+  if (poller->sq_ring == MAP_FAILED || poller->cq_ring == MAP_FAILED || poller->sqes == MAP_FAILED) {
+    hspoller_free(poller);
+    return NULL;
+  }
+
+  char *sq = (char*)poller->sq_ring;
+  poller->sq_head = (unsigned*)(sq + params.sq_off.head);
+  poller->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+  poller->sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+  poller->sq_entries = *(unsigned*)(sq + params.sq_off.ring_entries);
+  poller->sq_array = (unsigned*)(sq + params.sq_off.array);
+
+  char *cq = (char*)poller->cq_ring;
+  poller->cq_head = (unsigned*)(cq + params.cq_off.head);
+  poller->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+  poller->cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+  poller->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+  /* Without them, accept() and recv() are called directly after polling */
+  poller->multishot_accept = 1;
+  poller->multishot_recv = uring_setup_buffers(poller) == 0;
+
+  return poller;
+}
+
+void hspoller_free(struct hspoller *poller) {
+  for (int fd = 0; fd < poller->num_of_fds; fd++) {
+    if (poller->fds[fd].mode == HSURING_ACCEPT) {
+      uring_drop_queue(poller, fd);
+    }
+  }
+  if (poller->sqes && poller->sqes != MAP_FAILED) {
+    munmap(poller->sqes, poller->sqes_size);
+  }
+  if (poller->cq_ring && poller->cq_ring != MAP_FAILED && poller->cq_ring != poller->sq_ring) {
+    munmap(poller->cq_ring, poller->cq_ring_size);
+  }
+  if (poller->sq_ring && poller->sq_ring != MAP_FAILED) {
+    munmap(poller->sq_ring, poller->sq_ring_size);
+  }
+  close(poller->ringfd);
+  if (poller->buf_ring) {
+    munmap(poller->buf_ring, HSURING_BUFFERS * sizeof(struct io_uring_buf));
+    munmap(poller->buf_data, (size_t)HSURING_BUFFERS * HSURING_BUFFER_SIZE);
+  }
+  free(poller->buffers);
+  free(poller->fds);
+  free(poller);
+}
+
+int hspoller_ctl(struct hspoller *poller, int op, int fd, uint32_t events, uint64_t data) {
+  if (fd < 0 || uring_reserve(poller, fd) < 0) {
+    return -1;
+  }
+  struct hsuring_fd *state = &poller->fds[fd];
+  switch (op) {
+    case EPOLL_CTL_ADD: {
+      if (state->active) {
+        errno = EEXIST;
+        return -1;
+      }
+      for (int kind = 0; kind < HSURING_KINDS; kind++) {
+        state->generations[kind]++;
+      }
+      state->active = 1;
+      state->mode = HSURING_POLL;
+      state->armed = 0;
+      state->events = events;
+      state->data = data;
+      return uring_poll_add(poller, fd);
+    }
+    case EPOLL_CTL_MOD: {
+      if (!state->active) {
+        errno = ENOENT;
+        return -1;
+      }
+      /* Like epoll, a modification re-arms the request and reports the current readiness */
+      uring_poll_remove(poller, fd);
+      state->events = events;
+      state->data = data;
+      return uring_poll_add(poller, fd);
+    }
+    case EPOLL_CTL_DEL: {
+      if (!state->active) {
+        errno = ENOENT;
+        return -1;
+      }
+      uring_poll_remove(poller, fd);
+      if (state->armed && !state->cancelled) {
+        uring_cancel(poller, IORING_OP_ASYNC_CANCEL, uring_user_data(poller, fd, state->mode));
+      }
+      uring_drop_queue(poller, fd);
+      for (int kind = 0; kind < HSURING_KINDS; kind++) {
+        state->generations[kind]++;
+      }
+      state->active = 0;
+      state->mode = HSURING_POLL;
+      state->armed = 0;
+      return 0;
+    }
+    default: {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+}
+
+/**
+ * @brief Whether EPOLLIN of fd can be reported by a request of mode, it is switched if not yet.
+ */
+static int uring_can_complete(struct hspoller *poller, int fd, int mode) {
+  if ((mode == HSURING_ACCEPT && !poller->multishot_accept) ||
+      (mode == HSURING_RECV && !poller->multishot_recv) ||
+      fd < 0 || fd >= poller->num_of_fds || !poller->fds[fd].active) {
+    return 0;
+  }
+  if (poller->fds[fd].mode == HSURING_POLL) {
+    uring_switch(poller, fd, mode);
+  }
+  return poller->fds[fd].mode == mode;
+}
+
+int hspoller_accept(struct hspoller *poller, int fd, struct sockaddr *addr, socklen_t *addrlen) {
+  if (!uring_can_complete(poller, fd, HSURING_ACCEPT)) {
+    return accept(fd, addr, addrlen);
+  }
+  struct hsuring_fd *state = &poller->fds[fd];
+  if (state->head < 0) {
+    if (state->armed) {
+      errno = EAGAIN;
+      return -1;
+    }
+    int conn_sockfd = accept(fd, addr, addrlen);
+    if (conn_sockfd < 0 && errno == EAGAIN) {
+      uring_arm(poller, fd);
+      errno = EAGAIN;
+    }
+    return conn_sockfd;
+  }
+  int conn_sockfd = state->head;
+  state->head = poller->fds[conn_sockfd].next;
+  if (state->head < 0) {
+    state->tail = -1;
+  }
+  /* The address is not recorded by a multishot accept, all completions would share it */
+  if (addr) {
+    getpeername(conn_sockfd, addr, addrlen);
+  }
+  return conn_sockfd;
+}
+
+ssize_t hspoller_recv(struct hspoller *poller, int fd, void *buf, size_t length) {
+  if (!uring_can_complete(poller, fd, HSURING_RECV)) {
+    return recv(fd, buf, length, 0);
+  }
+  struct hsuring_fd *state = &poller->fds[fd];
+  if (state->head < 0) {
+    if (state->armed) {
+      errno = EAGAIN;
+      return -1;
+    }
+    /* Nothing is received ahead of the socket, e.g. the buffer ring ran out */
+    ssize_t bytes_recv = recv(fd, buf, length, 0);
+    if (bytes_recv < 0 && errno == EAGAIN) {
+      uring_arm(poller, fd);
+      errno = EAGAIN;
+    }
+    return bytes_recv;
+  }
+  size_t copied = 0;
+  while (copied < length && state->head >= 0) {
+    int bid = state->head;
+    size_t bytes = poller->buffers[bid].length - state->offset;
+    if (bytes > length - copied) {
+      bytes = length - copied;
+    }
+    memcpy((char*)buf + copied, poller->buf_data + (size_t)bid * HSURING_BUFFER_SIZE + state->offset, bytes);
+    copied += bytes;
+    state->offset += bytes;
+    state->queued -= bytes;
+    if (state->offset == poller->buffers[bid].length) {
+      state->head = poller->buffers[bid].next;
+      if (state->head < 0) {
+        state->tail = -1;
+      }
+      state->offset = 0;
+      uring_give_back(poller, bid);
+    }
+  }
+  return (ssize_t)copied;
+}
+
+/**
+ * @brief Add events to the ready event of fd, one fd is reported once by a hspoller_wait().
+ */
+static void uring_report(struct hspoller *poller, struct epoll_event *events, int *nready,
+                         int fd, uint32_t flags) {
+  struct hsuring_fd *state = &poller->fds[fd];
+  if (state->reported == poller->serial && state->index < *nready) {
+    events[state->index].events |= flags;
+    return ;
+  }
+  state->reported = poller->serial;
+  state->index = *nready;
+  events[*nready].events = flags;
+  events[*nready].data.u64 = state->data;
+  (*nready)++;
+}
+
+static void uring_complete_poll(struct hspoller *poller, int fd, struct io_uring_cqe *cqe,
+                                struct epoll_event *events, int *nready) {
+  if (cqe->res < 0 && cqe->res != -ECANCELED) {
+    poller->fds[fd].polling = 0;
+    uring_report(poller, events, nready, fd, EPOLLERR);
+    return ;
+  }
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    uring_poll_add(poller, fd); // The request has terminated, arm it again
+  }
+  if (cqe->res > 0) {
+    uring_report(poller, events, nready, fd, (uint32_t)cqe->res);
+  }
+}
+
+static void uring_complete_accept(struct hspoller *poller, int fd, struct io_uring_cqe *cqe,
+                                  struct epoll_event *events, int *nready) {
+  if (cqe->res >= 0) {
+    int conn_sockfd = cqe->res;
+    if (uring_reserve(poller, conn_sockfd) < 0) {
+      close(conn_sockfd);
+    } else {
+      struct hsuring_fd *state = &poller->fds[fd];
+      poller->fds[conn_sockfd].next = -1;
+      if (state->tail < 0) {
+        state->head = conn_sockfd;
+      } else {
+        poller->fds[state->tail].next = conn_sockfd;
+      }
+      state->tail = conn_sockfd;
+    }
+  }
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    poller->fds[fd].armed = 0;
+    if (cqe->res == -EINVAL) {
+      poller->multishot_accept = 0;
+    }
+  }
+  uring_report(poller, events, nready, fd, EPOLLIN);
+}
+
+static void uring_complete_recv(struct hspoller *poller, int fd, struct io_uring_cqe *cqe,
+                                struct epoll_event *events, int *nready) {
+  struct hsuring_fd *state = &poller->fds[fd];
+  if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+    int bid = (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    poller->buffers[bid].length = (uint32_t)cqe->res;
+    poller->buffers[bid].next = -1;
+    if (state->tail < 0) {
+      state->head = bid;
+    } else {
+      poller->buffers[state->tail].next = bid;
+    }
+    state->tail = bid;
+    state->queued += (size_t)cqe->res;
+  }
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    state->armed = 0;
+    if (cqe->res == -EINVAL) {
+      poller->multishot_recv = 0;
+    }
+  } else if (state->queued >= HSURING_RECV_MAX && !state->cancelled) {
+    /* The callback does not keep up, e.g. its output is blocked, the rest waits in the socket */
+    uring_cancel(poller, IORING_OP_ASYNC_CANCEL, cqe->user_data);
+    state->cancelled = 1;
+  }
+  /* The end of the stream follows all the data received before it */
+  uring_report(poller, events, nready, fd, cqe->res == 0 ? (EPOLLIN | EPOLLRDHUP) : EPOLLIN);
+}
+
+int hspoller_wait(struct hspoller *poller, struct epoll_event *events, int max_events, int timeout) {
+  unsigned head = *poller->cq_head;
+  unsigned min_complete = 0;
+  if (timeout != 0 && head == __atomic_load_n(poller->cq_tail, __ATOMIC_ACQUIRE)) {
+    min_complete = 1;
+  }
+  if (uring_enter(poller, min_complete, timeout) < 0) {
+    return -1;
+  }
+
+  int nready = 0;
+  poller->serial++;
+  unsigned tail = __atomic_load_n(poller->cq_tail, __ATOMIC_ACQUIRE);
+  while (head != tail && nready < max_events) {
+    struct io_uring_cqe *cqe = &poller->cqes[head & poller->cq_mask];
+    head++;
+    if (cqe->user_data == HSURING_IGNORE) {
+      continue;
+    }
+    int fd = (int)(cqe->user_data & HSURING_FD_MASK);
+    int kind = (int)((cqe->user_data >> 30) & 3);
+    uint32_t generation = (uint32_t)(cqe->user_data >> 32);
+    if (fd >= poller->num_of_fds || !poller->fds[fd].active ||
+        poller->fds[fd].generations[kind] != generation) {
+      uring_drop_completion(poller, kind, cqe); // Completion of a removed or replaced request
+      continue;
+    }
+    if (kind == HSURING_POLL) {
+      uring_complete_poll(poller, fd, cqe, events, &nready);
+    } else if (kind == HSURING_ACCEPT) {
+      uring_complete_accept(poller, fd, cqe, events, &nready);
+    } else {
+      uring_complete_recv(poller, fd, cqe, events, &nready);
+    }
+  }
+  __atomic_store_n(poller->cq_head, head, __ATOMIC_RELEASE);
+
+  return nready;
+}
+
+const char* hspoller_name() {
+  return "io_uring";
+}
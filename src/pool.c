@@ -0,0 +1,119 @@
+/**
+ * @file pool.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ */
+
+#include "pool.h"
+
+#include <stdlib.h>
+
+#define HSPOOL_CLASSES (HSPOOL_MAX_SHIFT - HSPOOL_MIN_SHIFT + 1)
+
+/* A free block stores the link to the next free block in itself */
+struct hspool_block {
+  struct hspool_block *next;
+};
+
+struct hspool_class {
+  struct hspool_block *free_list;
+  size_t num_of_free;   // Number of blocks in free_list
+  size_t max_free;      // Maximum number of blocks kept in free_list
+};
+
+struct hspool {
+  struct hspool_class classes[HSPOOL_CLASSES];
+  struct hspool_stats stats;
+};
+
+/**
+ * @return The index of the class, or -1 if size is larger than the largest class.
+ */
+static int class_index(size_t size) {
+  int shift = HSPOOL_MIN_SHIFT;
+  while (shift <= HSPOOL_MAX_SHIFT && ((size_t)1 << shift) < size) {
+    shift++;
+  }
+  return shift > HSPOOL_MAX_SHIFT ? -1 : shift - HSPOOL_MIN_SHIFT;
+}
+
+struct hspool* hspool_init() {
+  struct hspool *pool = (struct hspool*)malloc(sizeof(struct hspool));
+  if (!pool) {
+    return NULL;
+  }
+  for (int i = 0; i < HSPOOL_CLASSES; i++) {
+    pool->classes[i].free_list = NULL;
+    pool->classes[i].num_of_free = 0;
+    pool->classes[i].max_free = HSPOOL_CLASS_BYTES >> (i + HSPOOL_MIN_SHIFT);
+  }
+  pool->stats.hits = 0;
+  pool->stats.misses = 0;
+  pool->stats.cached = 0;
+  return pool;
+}
+
+void hspool_free(struct hspool *pool) {
+  if (!pool) {
+    return ;
+  }
+  for (int i = 0; i < HSPOOL_CLASSES; i++) {
+    struct hspool_block *block = pool->classes[i].free_list;
+    while (block) {
+      struct hspool_block *next = block->next;
+      free(block);
+      block = next;
+    }
+  }
+  free(pool);
+}
+
+size_t hspool_class_size(size_t size) {
+  int index = class_index(size);
+  return index < 0 ? size : (size_t)1 << (index + HSPOOL_MIN_SHIFT);
+}
+
+void* hspool_alloc(struct hspool *pool, size_t size) {
+  int index = class_index(size);
+  if (!pool || index < 0) {
+    if (pool) {
+      pool->stats.misses++;
+    }
+    return malloc(size);
+  }
+
+  struct hspool_class *class = &pool->classes[index];
+  if (class->free_list) {
+    struct hspool_block *block = class->free_list;
+    class->free_list = block->next;
+    class->num_of_free--;
+    pool->stats.hits++;
+    pool->stats.cached -= hspool_class_size(size);
+    return (void*)block;
+  }
+  pool->stats.misses++;
+  return malloc(hspool_class_size(size));
+}
+
+void hspool_put(struct hspool *pool, void *ptr, size_t size) {
+  if (!ptr) {
+    return ;
+  }
+  int index = class_index(size);
+  if (!pool || index < 0 || pool->classes[index].num_of_free >= pool->classes[index].max_free) {
+    free(ptr);
+    return ;
+  }
+
+  struct hspool_class *class = &pool->classes[index];
+  struct hspool_block *block = (struct hspool_block*)ptr;
+  block->next = class->free_list;
+  class->free_list = block;
+  class->num_of_free++;
+  pool->stats.cached += hspool_class_size(size);
+}
+
+struct hspool_stats hspool_stats(const struct hspool *pool) {
+  return pool->stats;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file range.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ */
+
+#include "range.h"
+
+#include <strings.h>
+
+#define HSRANGE_MAX_DIGITS 18  // Positions up to 10^18 - 1
+
+static int is_space(char ch) {
+  return ch == ' ' || ch == '\t';
+}
+
+/**
+ * @return The number of digits parsed, 0 if there is none or too many.
+ */
+static size_t parse_position(const char *value, size_t length, uint64_t *result) {
+  size_t i = 0;
+  *result = 0;
+  while (i < length && value[i] >= '0' && value[i] <= '9') {
+    if (i == HSRANGE_MAX_DIGITS) {
+      return 0;
+    }
+    *result = *result * 10 + (uint64_t)(value[i] - '0');
+    i++;
+  }
+  return i;
+}
+
+int hsrange_parse(const char *value, size_t length, uint64_t size, struct hsrange *ranges, int max) {
+  if (length < 6 || strncasecmp(value, "bytes=", 6)) {
+    return -1;
+  }
+  int count = 0;
+  int specs = 0;
+  size_t pos = 6;
+  while (pos < length) {
+    /* Empty elements of the list are allowed */
+    if (is_space(value[pos]) || value[pos] == ',') {
+      pos++;
+      continue;
+    }
+    if (++specs > max) {
+      return -1;
+    }
+    uint64_t first = 0, last = 0;
+    size_t digits = parse_position(value + pos, length - pos, &first);
+    pos += digits;
+    if (pos == length || value[pos] != '-') {
+      return -1;
+    }
+    pos++;
+    size_t last_digits = parse_position(value + pos, length - pos, &last);
+    pos += last_digits;
+    if (pos < length && !is_space(value[pos]) && value[pos] != ',') {
+      return -1;
+    }
+
+    if (digits == 0) {
+      /* The last bytes of the file */
+      if (last_digits == 0) {
+        return -1;
+      }
+      if (last == 0 || size == 0) {
+        continue;
+      }
+      first = last < size ? size - last : 0;
+      last = size - 1;
+    } else {
+      if (last_digits > 0 && last < first) {
+        return -1;
+      }
+      if (first >= size) {
+        continue;
+      }
+      if (last_digits == 0 || last >= size) {
+        last = size - 1;
+      }
+    }
+    ranges[count].first = first;
+    ranges[count].last = last;
+    count++;
+  }
+  return specs > 0 ? count : -1;
+}
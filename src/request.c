@@ -0,0 +1,180 @@
+/**
+ * @file request.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ */
+
+#include "request.h"
+#include "scan.h"
+
+#include <string.h>
+#include <strings.h>
+
+/*
+ * The known names are distinguished by their length, first and last character.
+ * A collision of two names is a duplicate initializer below, which does not compile with -Werror.
+ */
+#define HSHEADER_HASH(length, first, last) (((length) + ((first) | 0x20) + ((last) | 0x20) * 7) & 31)
+#define HSHEADER_NAME(id, name, first, last) [HSHEADER_HASH(sizeof(name) - 1, first, last)] = { name, sizeof(name) - 1, id }
+
+static const struct {
+  const char *name;
+  size_t length;
+  int id;
+} known_names[32] = {
+  HSHEADER_NAME(HSHEADER_HOST, "host", 'h', 't'),
+  HSHEADER_NAME(HSHEADER_CONNECTION, "connection", 'c', 'n'),
+  HSHEADER_NAME(HSHEADER_CONTENT_LENGTH, "content-length", 'c', 'h'),
+  HSHEADER_NAME(HSHEADER_CONTENT_TYPE, "content-type", 'c', 'e'),
+  HSHEADER_NAME(HSHEADER_TRANSFER_ENCODING, "transfer-encoding", 't', 'g'),
+  HSHEADER_NAME(HSHEADER_RANGE, "range", 'r', 'e'),
+  HSHEADER_NAME(HSHEADER_IF_RANGE, "if-range", 'i', 'e'),
+  HSHEADER_NAME(HSHEADER_IF_NONE_MATCH, "if-none-match", 'i', 'h'),
+  HSHEADER_NAME(HSHEADER_IF_MODIFIED_SINCE, "if-modified-since", 'i', 'e'),
+  HSHEADER_NAME(HSHEADER_ACCEPT_ENCODING, "accept-encoding", 'a', 'g'),
+  HSHEADER_NAME(HSHEADER_USER_AGENT, "user-agent", 'u', 't'),
+  HSHEADER_NAME(HSHEADER_ACCEPT, "accept", 'a', 't'),
+  HSHEADER_NAME(HSHEADER_COOKIE, "cookie", 'c', 'e'),
+  HSHEADER_NAME(HSHEADER_REFERER, "referer", 'r', 'r'),
+};
+
+#undef HSHEADER_NAME
+
+int hsheader_id(const char *name, size_t length) {
+  if (length == 0) {
+    return HSHEADER_OTHER;
+  }
+  unsigned index = HSHEADER_HASH(length, (unsigned char)name[0], (unsigned char)name[length - 1]);
+  if (known_names[index].length == length && !strncasecmp(known_names[index].name, name, length)) {
+    return known_names[index].id;
+  }
+  return HSHEADER_OTHER;
+}
+
+/**
+ * @brief Advance *pos over the characters of class flags.
+ *
+ * @return The number of characters skipped.
+ */
+static size_t skip_class(const char *buffer, size_t *pos, size_t end, int flags) {
+  size_t start = *pos;
+  *pos = hsscan_skip(buffer, start, end, flags);
+  return *pos - start;
+}
+
+static int expect_crlf(const char *buffer, size_t *pos, size_t end) {
+  if (*pos + 1 < end && buffer[*pos] == '\r' && buffer[*pos + 1] == '\n') {
+    *pos += 2;
+    return 1;
+  }
+  return 0;
+}
+
+static void slice_set(struct hsslice *slice, size_t start, size_t end) {
+  slice->offset = (uint32_t)start;
+  slice->length = (uint32_t)(end - start);
+}
+
+/**
+ * @brief Parse the request line and the header fields of a complete request.
+ */
+static int parse_headers(struct hsrequest *request, const char *buffer, size_t end) {
+  size_t pos = 0;
+  size_t start = pos;
+
+  /* Request line: method SP request-target SP HTTP-version CRLF */
+  if (!skip_class(buffer, &pos, end, HSSCAN_TOKEN) || buffer[pos] != ' ') {
+    return HSPARSE_INVALID;
+  }
+  slice_set(&request->method, start, pos++);
+  start = pos;
+  if (!skip_class(buffer, &pos, end, HSSCAN_URI) || buffer[pos] != ' ') {
+    return HSPARSE_INVALID;
+  }
+  slice_set(&request->uri, start, pos++);
+  start = pos;
+  if (!skip_class(buffer, &pos, end, HSSCAN_URI)) {
+    return HSPARSE_INVALID;
+  }
+  slice_set(&request->version, start, pos);
+  if (!expect_crlf(buffer, &pos, end)) {
+    return HSPARSE_INVALID;
+  }
+
+  /* Header fields: field-name ":" OWS field-value OWS CRLF */
+  while (!expect_crlf(buffer, &pos, end)) {
+    if (request->header_count == HSREQUEST_MAX_HEADERS) {
+      return HSPARSE_INVALID;
+    }
+    struct hsrequest_header *header = &request->headers[request->header_count];
+    start = pos;
+    if (!skip_class(buffer, &pos, end, HSSCAN_TOKEN) || buffer[pos] != ':') {
+      return HSPARSE_INVALID;
+    }
+    slice_set(&header->name, start, pos++);
+    header->id = hsheader_id(buffer + start, header->name.length);
+    if (header->id != HSHEADER_OTHER && !request->known[header->id]) {
+      request->known[header->id] = (uint8_t)(request->header_count + 1);
+    }
+    while (buffer[pos] == ' ' || buffer[pos] == '\t') {
+      pos++;
+    }
+    start = pos;
+    skip_class(buffer, &pos, end, HSSCAN_VALUE);
+    size_t value_end = pos;
+    while (value_end > start && (buffer[value_end - 1] == ' ' || buffer[value_end - 1] == '\t')) {
+      value_end--;
+    }
+    slice_set(&header->value, start, value_end);
+    if (!expect_crlf(buffer, &pos, end)) {
+      return HSPARSE_INVALID;
+    }
+    request->header_count++;
+  }
+  return pos == end ? HSPARSE_VALID : HSPARSE_INVALID;
+}
+
+void hsparser_init(struct hsparser *parser) {
+  parser->scanned = 0;
+}
+
+int hsrequest_parse(struct hsrequest *request, struct hsparser *parser, const char *buffer, size_t size) {
+  /* The last 3 bytes searched can be the beginning of the empty line */
+  size_t start = parser && parser->scanned > 3 ? parser->scanned - 3 : 0;
+  request->base = buffer;
+  request->header_count = 0;
+  memset(request->known, 0, sizeof(request->known));
+  request->length = hsscan_headers_end(buffer, size, start);
+  if (request->length == 0) {
+    if (parser) {
+      parser->scanned = size;
+    }
+    return HSPARSE_INCOMPLETE;
+  }
+  if (parser) {
+    hsparser_init(parser);
+  }
+  return parse_headers(request, buffer, request->length);
+}
+
+int hsslice_equal(const struct hsrequest *request, struct hsslice slice, const char *str) {
+  return strlen(str) == slice.length && !memcmp(hsrequest_ptr(request, slice), str, slice.length);
+}
+
+int hsslice_equal_nocase(const struct hsrequest *request, struct hsslice slice, const char *str) {
+  return strlen(str) == slice.length && !strncasecmp(hsrequest_ptr(request, slice), str, slice.length);
+}
+
+const struct hsrequest_header* hsrequest_find(const struct hsrequest *request, const char *name) {
+  int id = hsheader_id(name, strlen(name));
+  if (id != HSHEADER_OTHER) {
+    return hsrequest_get(request, id);
+  }
+  for (int i = 0; request && i < request->header_count; i++) {
+    if (hsslice_equal_nocase(request, request->headers[i].name, name)) {
+      return &request->headers[i];
+    }
+  }
+  return NULL;
+}
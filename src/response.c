@@ -5,18 +5,24 @@
  * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
  */
 
+#define _GNU_SOURCE
+
 #include "utils.h"
 #include "response.h"
 #include "buffer.h"
+#include "gzip.h"
 #include "log.h"
+#include "range.h"
 
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/epoll.h>
+#include <time.h>
 
 char file_path[256];
 int initial_length;
@@ -24,18 +30,20 @@ int initial_length;
 char cgi_folder[128];
 int cgifolder_length;
 
-int cur_entity_length = 0;
-int fetched_entity_length = 0;
-
 const char *response_ok = "HTTP/1.1 200 OK\r\n";
+const char *partial_content = "HTTP/1.1 206 Partial Content\r\n";
+const char *not_modified = "HTTP/1.1 304 Not Modified\r\n";
 const char *bad_request = "HTTP/1.1 400 Bad Request\r\n";
 const char *not_exist = "HTTP/1.1 404 Not Found\r\n";
 const char *request_timeout = "HTTP/1.1 408 Request Timeout\r\n";
+const char *too_large = "HTTP/1.1 431 Request Header Fields Too Large\r\n";
+const char *not_satisfiable = "HTTP/1.1 416 Range Not Satisfiable\r\n";
 const char *server_error = "HTTP/1.1 500 Internal Server Error\r\n";
 const char *not_implemented = "HTTP/1.1 501 Not Implemented\r\n";
 const char *bad_version = "HTTP/1.1 505 HTTP Version Not Supported\r\n";
 
 const char *server = "Server: Knight/1.0\r\n";
+const char *vary = "Vary: Accept-Encoding\r\n";
 const char *conn_close = "Connection: Close\r\n";
 const char *conn_keep = "Connection: Keep-Alive\r\n";
 
@@ -57,21 +65,36 @@ const char *mime_type[6] = {
   "image/gif"
 };
 
+/* Precompressed sidecars, in the order of preference, gzip is also compressed on the fly */
+const char *content_coding[3] = {
+  "br",
+  "zstd",
+  "gzip"
+};
+
+const char *coding_suffix[3] = {
+  ".br",
+  ".zst",
+  ".gz"
+};
+
 static void response_ending(struct hsevent *event) {
   hsbuffer_ncpy(event->outbound, "\r\n", 2);
 }
 
-static int find_type(Request *request) {
-  int index = strlen(request->http_uri);
+static int find_type(struct hsrequest *request) {
+  const char *uri = hsrequest_ptr(request, request->uri);
+  int index = (int)request->uri.length - 1;
   int i;
   while (index >= 0) {
-    if (request->http_uri[index] == '.') {
+    if (uri[index] == '.') {
       break;
     }
     index--;
   }
+  size_t length = request->uri.length - index - 1;
   for (i = 0; i < 5; i++) {
-    if (!strcmp(request->http_uri + index + 1, file_type[i])) {
+    if (strlen(file_type[i]) == length && !memcmp(uri + index + 1, file_type[i], length)) {
       break;
     }
   }
@@ -79,12 +102,23 @@ static int find_type(Request *request) {
   return i;
 }
 
-static void find_file(struct hsevent *event, Request *request, int *fd, size_t *length) {
-  strcat(file_path, request->http_uri);
-  *fd = open(file_path, O_RDONLY);
-  file_path[initial_length] = '\0'; // remove the uri
+/**
+ * @brief Open the requested file through the file cache of the event loop.
+ * 
+ * @return A reference to the file, or NULL if the error response has been generated.
+ */
+static struct hsfile* find_file(struct hsevent *event, struct hsrequest *request) {
+  char path[512];
+  snprintf(path, 512, "%s%.*s", file_path, (int)request->uri.length, hsrequest_ptr(request, request->uri));
+  struct hsevent_base *base = event->event_base;
+  struct hsfile *file = hsfcache_open(base ? base->files : NULL, path, base ? base->now : 0);
+  if (file && !S_ISREG(file->st.st_mode)) {
+    hsfile_put(file);
+    file = NULL;
+    errno = ENOENT;
+  }
   int status;
-  if (*fd < 0) {
+  if (!file) {
     if (errno == EACCES) {
       hsbuffer_ncpy(event->outbound, bad_request, strlen(bad_request));
       status = 400;
@@ -93,15 +127,121 @@ static void find_file(struct hsevent *event, Request *request, int *fd, size_t *
       status = 404;
     }
     hsbuffer_ncpy(event->outbound, "Content-length: 0\r\n", 19);
-    *length = 0;
-    hslog_log(event->remote, request, status, (int)*length);
-  } else {
-    hsbuffer_ncpy(event->outbound, response_ok, strlen(response_ok));
-    char buf[128];
+    hslog_log(event->remote, request, status, 0);
+  }
+  return file;
+}
 
-    int index = find_type(request); 
-    snprintf(buf, 128, "Content-type: %s\r\n", mime_type[index]);
-    hsbuffer_ncpy(event->outbound, buf, strlen(buf));
+/**
+ * @brief Whether the requested file may have precompressed sidecars, only text is compressed.
+ */
+static int is_negotiable(struct hsrequest *request) {
+  return !strncmp(mime_type[find_type(request)], "text/", 5);
+}
+
+/**
+ * @brief Render the headers that describe the representation being sent.
+ * 
+ * @param[in] encoding The content coding of a sidecar, or NULL if file is the requested file.
+ */
+static int render_metadata(char *buf, size_t size, struct hsrequest *request, struct hsfile *file, 
+                           const char *encoding) {
+  int used = 0;
+  if (encoding) {
+    used = snprintf(buf, size, "Content-encoding: %s\r\n", encoding);
+  }
+  return used + snprintf(buf + used, size - used, "%sETag: %s\r\nLast-modified: %s\r\n", 
+                         is_negotiable(request) ? vary : "", file->etag, file->modified);
+}
+
+/**
+ * @brief Render the status line and the headers of a file, except Connection.
+ */
+static int render_file_headers(char *buf, size_t size, struct hsrequest *request, struct hsfile *file, 
+                               const char *encoding, size_t length) {
+  int used = snprintf(buf, size, "%sContent-type: %s\r\nContent-length: %zu\r\nAccept-ranges: bytes\r\n", 
+                      response_ok, mime_type[find_type(request)], length);
+  used += render_metadata(buf + used, size - used, request, file, encoding);
+  return used + snprintf(buf + used, size - used, "%s", server);
+}
+
+/**
+ * @brief Weak comparison of etag with a list of entity tags, e.g. W/"a", "b" or *.
+ */
+static int etag_matches(const char *list, size_t length, const char *etag) {
+  size_t etag_length = strlen(etag);
+  size_t pos = 0;
+  while (pos < length) {
+    if (list[pos] == ' ' || list[pos] == '\t' || list[pos] == ',') {
+      pos++;
+      continue;
+    }
+    if (list[pos] == '*') {
+      return 1;
+    }
+    if (length - pos > 2 && list[pos] == 'W' && list[pos + 1] == '/') {
+      pos += 2;
+    }
+    const char *end = list[pos] == '"' ? (const char*)memchr(list + pos + 1, '"', length - pos - 1) : NULL;
+    if (!end) {
+      return 0;
+    }
+    size_t tag_length = end - (list + pos) + 1;
+    if (tag_length == etag_length && !memcmp(list + pos, etag, tag_length)) {
+      return 1;
+    }
+    pos += tag_length;
+  }
+  return 0;
+}
+
+/**
+ * @return 1 if the copy the client has is still valid and 304 should be returned, otherwise 0.
+ */
+static int is_not_modified(struct hsrequest *request, struct hsfile *file) {
+  const struct hsrequest_header *match = hsrequest_get(request, HSHEADER_IF_NONE_MATCH);
+  if (match) {
+    /* If-Modified-Since is ignored when If-None-Match is present */
+    return etag_matches(hsrequest_ptr(request, match->value), match->value.length, file->etag);
+  }
+  const struct hsrequest_header *since = hsrequest_get(request, HSHEADER_IF_MODIFIED_SINCE);
+  if (!since || since->value.length >= 64) {
+    return 0;
+  }
+  /* Usually the client sends back the Last-Modified it got */
+  if (hsslice_equal(request, since->value, file->modified)) {
+    return 1;
+  }
+  char date[64];
+  memcpy(date, hsrequest_ptr(request, since->value), since->value.length);
+  date[since->value.length] = '\0';
+  struct tm tm;
+  memset(&tm, 0, sizeof(struct tm));
+  const char *end = strptime(date, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return end && *end == '\0' && file->st.st_mtime <= timegm(&tm);
+}
+
+/**
+ * @brief Generate the headers of a file for GET, except Connection.
+ * 
+ * @details
+ * The headers of a file kept in memory are rendered once, 
+ * and later responses queue them from the file cache together with the contents.
+ * A sidecar can also be requested by its own name, so its headers are not kept.
+ */
+static void response_file_headers(struct hsevent *event, struct hsrequest *request, struct hsfile *file, 
+                                  const char *encoding) {
+  if (encoding || !file->headers) {
+    char buf[512];
+    int size = render_file_headers(buf, 512, request, file, encoding, file->st.st_size);
+    struct hsfcache *cache = event->event_base ? event->event_base->files : NULL;
+    if (!file->data || encoding || hsfcache_set_headers(cache, file, buf, size) < 0) {
+      hsbuffer_ncpy(event->outbound, buf, size);
+      return ;
+    }
+  }
+  if (hsoutq_add_shared(event->outq, file->headers, file->headers_length, hsfile_get(file)) < 0) {
+    hsbuffer_ncpy(event->outbound, file->headers, file->headers_length);
   }
 }
 
@@ -113,17 +253,35 @@ void response_timeout(struct hsevent *event) {
   hslog_log(event->remote, NULL, 408, 0);
 }
 
-static void response_server_conn(struct hsevent *event, Request *request) {
-  hsbuffer_ncpy(event->outbound, server, strlen(server));
-  Request_header *header = find_key(request, "Connection");
-  if (!header || !strcmp(header->header_value, "Close")) {
+static void response_conn(struct hsevent *event, struct hsrequest *request) {
+  const struct hsrequest_header *header = hsrequest_get(request, HSHEADER_CONNECTION);
+  if (!header || hsslice_equal_nocase(request, header->value, "Close")) {
     hsbuffer_ncpy(event->outbound, conn_close, strlen(conn_close));
     event->closed = 1;
-  } else if (!strcmp(header->header_value, "Keep-Alive")) {
+  } else if (hsslice_equal_nocase(request, header->value, "Keep-Alive")) {
     hsbuffer_ncpy(event->outbound, conn_keep, strlen(conn_keep));
   }
 }
 
+static void response_server_conn(struct hsevent *event, struct hsrequest *request) {
+  hsbuffer_ncpy(event->outbound, server, strlen(server));
+  response_conn(event, request);
+}
+
+/**
+ * @brief Generate a 304 response, which only has headers.
+ */
+static void response_not_modified(struct hsevent *event, struct hsrequest *request, struct hsfile *file, 
+                                  const char *encoding) {
+  char buf[256];
+  hsbuffer_ncpy(event->outbound, not_modified, strlen(not_modified));
+  hsbuffer_ncpy(event->outbound, buf, render_metadata(buf, 256, request, file, encoding));
+  response_server_conn(event, request);
+  response_ending(event);
+  hslog_log(event->remote, request, 304, 0);
+  hsfile_put(file);
+}
+
 /**
  * @note
  * If the HTTP request has the wrong version, 
@@ -132,8 +290,8 @@ static void response_server_conn(struct hsevent *event, Request *request) {
  * 
  * @return 1 means wrong HTTP version, 0 means normal.
  */
-static int response_badversion(struct hsevent *event, Request *request) {
-  if (!strcmp("HTTP/1.1", request->http_version)) {
+static int response_badversion(struct hsevent *event, struct hsrequest *request) {
+  if (hsslice_equal(request, request->version, "HTTP/1.1")) {
     return 0;
   } else {
     hsbuffer_ncpy(event->outbound, bad_version, strlen(bad_version));
@@ -145,59 +303,154 @@ static int response_badversion(struct hsevent *event, Request *request) {
   return 1;
 }
 
-static void response_server_error(struct hsevent *event, Request *request) {
+static void response_server_error(struct hsevent *event, struct hsrequest *request) {
   hsbuffer_ncpy(event->outbound, server_error, strlen(server_error));
   response_server_conn(event, request);
   hsbuffer_ncpy(event->outbound, "Content-length: 0\r\n", 19);
   response_ending(event);
 }
 
-static int get_content_length(Request *request) {
-  for (int i = 0; i < request->header_count; i++) {
-    if (!strcmp(request->headers[i].header_name, "Content-length")) {
-      return atoi(request->headers[i].header_value);
-    }
+static int get_content_length(struct hsrequest *request) {
+  const struct hsrequest_header *header = hsrequest_get(request, HSHEADER_CONTENT_LENGTH);
+  /* The value always ends with \r, so atoi() stops in the request */
+  return header ? atoi(hsrequest_ptr(request, header->value)) : 0;
+}
+
+/**
+ * @return The value of the Content-type header field, or an empty slice if not found.
+ */
+static struct hsslice get_content_type(struct hsrequest *request) {
+  const struct hsrequest_header *header = hsrequest_get(request, HSHEADER_CONTENT_TYPE);
+  struct hsslice empty = { 0, 0 };
+  return header ? header->value : empty;
+}
+
+/**
+ * @return The part of the URI after '?', or an empty slice if there is no query string.
+ */
+static struct hsslice get_query_string(struct hsrequest *request) {
+  const char *uri = hsrequest_ptr(request, request->uri);
+  const char *mark = (const char*)memchr(uri, '?', request->uri.length);
+  struct hsslice query = { 0, 0 };
+  if (mark) {
+    query.offset = request->uri.offset + (mark - uri) + 1;
+    query.length = request->uri.length - (mark - uri) - 1;
   }
-  return 0;
+  return query;
+}
+
+/**
+ * @brief Stop writing the body to the CGI script, the bytes it has not read are discarded.
+ */
+static void cgi_close_body(struct hsevent *event) {
+  hsevent_base_detach(event->pipe_wfd, event);
+  close(event->pipe_wfd);
+  event->pipe_wfd = -1;
+  free(event->pipe_pending);
+  event->pipe_pending = NULL;
+  event->pipe_length = 0;
+  event->pipe_eof = 0;
 }
 
-static const char* get_content_type(Request *request) {
-  for (int i = 0; i < request->header_count; i++) {
-    if (!strcmp(request->headers[i].header_name, "Content-type")) {
-      return request->headers[i].header_value;
+/**
+ * @brief Write as much of data to the stdin of the CGI script as the pipe takes without blocking.
+ * 
+ * @return The number of bytes written, or -1 if the script no longer reads its input.
+ */
+static ssize_t cgi_write(struct hsevent *event, const char *data, size_t size) {
+  size_t written = 0;
+  while (written < size) {
+    ssize_t bytes_written = write(event->pipe_wfd, data + written, size - written);
+    if (bytes_written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN) {
+        break;
+      }
+      return -1;  // EPIPE, the script has exited or closed its stdin
     }
+    written += (size_t)bytes_written;
+  }
+  return (ssize_t)written;
+}
+
+void response_cgi_body(struct hsevent *event) {
+  if (event->pipe_wfd < 0 || event->pipe_length == 0) {
+    return ;
+  }
+  ssize_t written = cgi_write(event, event->pipe_pending, event->pipe_length);
+  if (written < 0) {
+    cgi_close_body(event);
+    return ;
+  }
+  event->pipe_length -= (size_t)written;
+  memmove(event->pipe_pending, event->pipe_pending + written, event->pipe_length);
+  if (event->pipe_length == 0 && event->pipe_eof) {
+    cgi_close_body(event);
   }
-  return NULL;
 }
 
-static const char* get_query_string(Request *request) {
-  for (size_t i = 0; i < strlen(request->http_uri); i++) {
-    if (request->http_uri[i] == '?') {
-      return request->http_uri + i + 1;
+/**
+ * @brief The body sink of CGI requests, the pipe is closed at the end of the body.
+ * 
+ * @details
+ * The bytes that do not fit in the pipe are kept in event->pipe_pending,
+ * and response_cgi_body() writes them once the pipe is writable again.
+ */
+static void cgi_write_body(void *ctx, const char *data, size_t size) {
+  struct hsevent *event = (struct hsevent*)ctx;
+  if (event->pipe_wfd < 0) {
+    return ;
+  }
+  if (!data) {
+    if (event->pipe_length == 0) {
+      cgi_close_body(event);
+    } else {
+      event->pipe_eof = 1;
+    }
+    return ;
+  }
+  ssize_t written = 0;
+  if (event->pipe_length == 0) {
+    written = cgi_write(event, data, size);
+    if (written < 0) {
+      cgi_close_body(event);
+      return ;
+    }
+  }
+  if ((size_t)written < size) {
+    char *pending = (char*)realloc(event->pipe_pending, event->pipe_length + size - (size_t)written);
+    if (!pending) {
+      cgi_close_body(event);
+      return ;
     }
+    memcpy(pending + event->pipe_length, data + written, size - (size_t)written);
+    event->pipe_pending = pending;
+    event->pipe_length += size - (size_t)written;
   }
-  return NULL;
 }
 
 /**
  * @return 1 means the response is generated by the cgi script, 
  * and 0 means the response is generated by the server.
  */
-static int response_cgi(struct hsevent *event, Request *request) {
-  if (strncmp(request->http_uri, "/cgi/", 5)) {
+static int response_cgi(struct hsevent *event, struct hsrequest *request) {
+  const char *uri = hsrequest_ptr(request, request->uri);
+  if (request->uri.length < 5 || memcmp(uri, "/cgi/", 5)) {
     return 0;
   }
 
   pid_t pid;
   int stdin_pipe[2];
   int stdout_pipe[2];
-  char script[128];
-  if (pipe(stdin_pipe) || pipe(stdout_pipe)) {
+  char script[512];
+  /* Both pipes are closed on exec, so a script never holds the pipes of other requests */
+  if (pipe2(stdin_pipe, O_CLOEXEC) || pipe2(stdout_pipe, O_CLOEXEC)) {
     response_server_error(event, request);
     return 1;
   }
-  strcpy(script, cgi_folder);
-  strcat(script, request->http_uri + 4);
+  snprintf(script, 512, "%s%.*s", cgi_folder, (int)request->uri.length - 4, uri + 4);
   char environment[32][500];
   char *env[32];
   char *args[2];
@@ -207,25 +460,30 @@ static int response_cgi(struct hsevent *event, Request *request) {
   char remote_addr[17];
   memset(remote_addr, 0, 17);
   inet_ntop(AF_INET, &event->remote->sin_addr, remote_addr, INET_ADDRSTRLEN);
-  sprintf(environment[0],  "CONTENT_LENGTH=%d", get_content_length(request));
-  sprintf(environment[1],  "CONTENT_TYPE=%s", get_content_type(request));
-  sprintf(environment[2],  "GATEWAY_INTERFACE=%s", "CGI/1.1");
-  sprintf(environment[3],  "QUERY_STRING=%s", get_query_string(request));
-  sprintf(environment[4],  "REMOTE_ADDR=%s", remote_addr);
-  sprintf(environment[5],  "REQUEST_METHOD=%s", request->http_method);
-  sprintf(environment[6],  "REQUEST_URI=%s", request->http_uri);
-  sprintf(environment[7],  "SCRIPT_NAME=%s", request->http_uri + 5);
-  sprintf(environment[8],  "SERVER_PORT=%d", https_port);
-  sprintf(environment[9],  "SERVER_PROTOCOL=%s", "HTTP/1.1");
-  sprintf(environment[10], "SERVER_SOFTNAME=%s", "Knight/1.0");
-  for (int i = 0; i < request->header_count; i++) {
-    if (!strcmp(request->headers[i].header_name, "Content-length") || 
-        !strcmp(request->headers[i].header_name, "Content-type")) {
+  struct hsslice content_type = get_content_type(request);
+  struct hsslice query_string = get_query_string(request);
+  snprintf(environment[0],  500, "CONTENT_LENGTH=%d", get_content_length(request));
+  snprintf(environment[1],  500, "CONTENT_TYPE=%.*s", (int)content_type.length, hsrequest_ptr(request, content_type));
+  snprintf(environment[2],  500, "GATEWAY_INTERFACE=%s", "CGI/1.1");
+  snprintf(environment[3],  500, "QUERY_STRING=%.*s", (int)query_string.length, hsrequest_ptr(request, query_string));
+  snprintf(environment[4],  500, "REMOTE_ADDR=%s", remote_addr);
+  snprintf(environment[5],  500, "REQUEST_METHOD=%.*s", (int)request->method.length, hsrequest_ptr(request, request->method));
+  snprintf(environment[6],  500, "REQUEST_URI=%.*s", (int)request->uri.length, uri);
+  snprintf(environment[7],  500, "SCRIPT_NAME=%.*s", (int)request->uri.length - 5, uri + 5);
+  snprintf(environment[8],  500, "SERVER_PORT=%d", https_port);
+  snprintf(environment[9],  500, "SERVER_PROTOCOL=%s", "HTTP/1.1");
+  snprintf(environment[10], 500, "SERVER_SOFTNAME=%s", "Knight/1.0");
+  for (int i = 0; i < request->header_count && num_of_env < 31; i++) {
+    const struct hsrequest_header *header = &request->headers[i];
+    if (header->id == HSHEADER_CONTENT_LENGTH || header->id == HSHEADER_CONTENT_TYPE) {
       continue;    
     }
-    convertstr(request->headers[i].header_name);
-    sprintf(environment[num_of_env], "HTTP_%s=%s", request->headers[i].header_name,
-                                                   request->headers[i].header_value);
+    char name[128];
+    snprintf(name, 128, "%.*s", (int)header->name.length, hsrequest_ptr(request, header->name));
+    convertstr(name);
+    snprintf(environment[num_of_env], 500, "HTTP_%s=%.*s", name, 
+                                                           (int)header->value.length, 
+                                                           hsrequest_ptr(request, header->value));
     num_of_env++;
   }
   for (int i = 0; i < num_of_env; i++) {
@@ -246,6 +504,7 @@ static int response_cgi(struct hsevent *event, Request *request) {
     dup2(stdout_pipe[1], fileno(stdout));
     close(stdin_pipe[0]);
     close(stdout_pipe[1]);
+    signal(SIGPIPE, SIG_DFL);  // Ignored by the server, but scripts expect the default
     if (execve("../cgi/ascii_art.py", args, env) < 0) {
       perror("execve()");
       response_server_error(event, request);
@@ -256,58 +515,297 @@ static int response_cgi(struct hsevent *event, Request *request) {
     close(stdin_pipe[0]);
     close(stdout_pipe[1]);
     event->pipe_rfd = stdout_pipe[0]; // parent process reads from the stout of child process
-    struct epoll_event ev;
-    ev.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
-    ev.data.fd = event->pipe_rfd;
-    event->event_base->sockets[stdout_pipe[0]] = event;
-    epoll_ctl(event->event_base->epollfd, EPOLL_CTL_ADD, stdout_pipe[0], &ev);
+    hsevent_base_attach(event->pipe_rfd, EPOLLIN | EPOLLET | EPOLLRDHUP, event);
     set_nonblocking(stdout_pipe[0]);
-    ssize_t bytes_written;
-    bytes_written = write(stdin_pipe[1], hsbuffer_pos(event->inbound, READ_POS), hsbuffer_readable(event->inbound));
-    if (bytes_written < 0) {
-      response_server_error(event, request);
-      return 1;
-    } else {
-      hsbuffer_consume(event->inbound, bytes_written);
+    /* The body is written to the stdin of the child process as it arrives, without blocking the loop */
+    if (event->pipe_wfd >= 0) {
+      cgi_close_body(event);  // Left by the previous request on the connection
     }
-    close(stdin_pipe[1]);
+    event->pipe_wfd = stdin_pipe[1];
+    set_nonblocking(event->pipe_wfd);
+    hsevent_base_attach(event->pipe_wfd, EPOLLOUT | EPOLLET, event);
+    event->body.sink = cgi_write_body;
+    event->body.ctx = event;
   }
   return 1;
 }
 
-static void response_head(struct hsevent *event, Request *request, int *fd, size_t *length) {
+static void response_head(struct hsevent *event, struct hsrequest *request) {
   if (response_cgi(event, request)) {
     return ;
   }
-  find_file(event, request, fd, length);
-  if (*fd > 0) {
-    hsbuffer_ncpy(event->outbound, "Content-length: 0\r\n", 19);
+  struct hsfile *file = find_file(event, request);
+  if (file && is_not_modified(request, file)) {
+    response_not_modified(event, request, file, NULL);
+    return ;
+  }
+  if (file) {
+    char buf[512];
+    hsbuffer_ncpy(event->outbound, buf, render_file_headers(buf, 512, request, file, NULL, 0));
     hslog_log(event->remote, request, 200, 0);
-    *fd = -1; // Don't let write_conn() send file.
+    hsfile_put(file); // Don't let write_conn() send file.
+    response_conn(event, request);
+  } else {
+    response_server_conn(event, request);
   }
-  response_server_conn(event, request);
   response_ending(event);
 }
 
-static void response_get(struct hsevent *event, Request *request, int *fd, size_t *length) {
-  if (response_cgi(event, request)) {
+/**
+ * @brief Append length bytes of file starting at offset to the output chain, the reference is taken over.
+ */
+static void queue_file(struct hsevent *event, struct hsfile *file, uint64_t offset, uint64_t length) {
+  if (hsoutq_add_hsfile(event->outq, file, (off_t)offset, (size_t)length) < 0) {
+    event->closed = 1;  // The response is incomplete
+  }
+}
+
+/**
+ * @return 1 if the Range of request applies to file, 0 if the whole file must be sent.
+ */
+static int if_range_matches(struct hsrequest *request, struct hsfile *file) {
+  const struct hsrequest_header *header = hsrequest_get(request, HSHEADER_IF_RANGE);
+  if (!header) {
+    return 1;
+  }
+  /* Only a strong validator, the entity tag or the exact Last-Modified */
+  return hsslice_equal(request, header->value, file->etag) || hsslice_equal(request, header->value, file->modified);
+}
+
+static int render_part_header(char *buf, size_t size, const char *boundary, const char *type, 
+                              const struct hsrange *range, uint64_t file_size) {
+  return snprintf(buf, size, "\r\n--%s\r\nContent-type: %s\r\nContent-range: bytes %llu-%llu/%llu\r\n\r\n", 
+                  boundary, type, (unsigned long long)range->first, (unsigned long long)range->last,
+                  (unsigned long long)file_size);
+}
+
+/**
+ * @brief Generate a 206 response with the ranges of file, or a 416 response if there is none.
+ * 
+ * @details
+ * Every range is a separate segment of the output chain, so it is sent by sendfile() at its offset
+ * (or from memory if the file cache keeps the file).
+ * More than one range is sent as multipart/byteranges.
+ */
+static void response_ranges(struct hsevent *event, struct hsrequest *request, struct hsfile *file, 
+                            const char *encoding, const struct hsrange *ranges, int count) {
+  char buf[256];
+  uint64_t file_size = (uint64_t)file->st.st_size;
+  const char *type = mime_type[find_type(request)];
+  if (count == 0) {
+    hsbuffer_ncpy(event->outbound, not_satisfiable, strlen(not_satisfiable));
+    snprintf(buf, 256, "Content-range: bytes */%llu\r\nContent-length: 0\r\n", (unsigned long long)file_size);
+    hsbuffer_ncpy(event->outbound, buf, strlen(buf));
+    response_server_conn(event, request);
+    response_ending(event);
+    hslog_log(event->remote, request, 416, 0);
+    hsfile_put(file);
     return ;
   }
-  find_file(event, request, fd, length);
-  if (*fd > 0) {
-    char buf[128];
-    struct stat file_stat;
-    fstat(*fd, &file_stat);
-    *length = file_stat.st_size;
-    snprintf(buf, 128, "Content-length: %ld\r\n", *length);
+
+  hsbuffer_ncpy(event->outbound, partial_content, strlen(partial_content));
+  if (count == 1) {
+    uint64_t length = ranges[0].last - ranges[0].first + 1;
+    snprintf(buf, 256, "Content-type: %s\r\nContent-range: bytes %llu-%llu/%llu\r\nContent-length: %llu\r\n", 
+             type, (unsigned long long)ranges[0].first, (unsigned long long)ranges[0].last, 
+             (unsigned long long)file_size, (unsigned long long)length);
     hsbuffer_ncpy(event->outbound, buf, strlen(buf));
-    hslog_log(event->remote, request, 200, (int)*length);
+    hsbuffer_ncpy(event->outbound, buf, render_metadata(buf, 256, request, file, encoding));
+    response_server_conn(event, request);
+    response_ending(event);
+    hslog_log(event->remote, request, 206, (int)length);
+    queue_file(event, file, ranges[0].first, length);
+    return ;
+  }
+
+  /* Derived from the file, so a cached copy of the response stays valid */
+  char boundary[48];
+  snprintf(boundary, 48, "%016llx%016llx", (unsigned long long)file->st.st_ino, 
+           (unsigned long long)file->st.st_mtim.tv_nsec ^ (unsigned long long)file->st.st_mtime);
+  uint64_t length = 4 + strlen(boundary) + 4;  // "\r\n--" boundary "--\r\n"
+  for (int i = 0; i < count; i++) {
+    length += render_part_header(buf, 256, boundary, type, &ranges[i], file_size);
+    length += ranges[i].last - ranges[i].first + 1;
   }
+  snprintf(buf, 256, "Content-type: multipart/byteranges; boundary=%s\r\nContent-length: %llu\r\n", 
+           boundary, (unsigned long long)length);
+  hsbuffer_ncpy(event->outbound, buf, strlen(buf));
+  hsbuffer_ncpy(event->outbound, buf, render_metadata(buf, 256, request, file, encoding));
   response_server_conn(event, request);
   response_ending(event);
+  hslog_log(event->remote, request, 206, (int)length);
+  for (int i = 0; i < count; i++) {
+    hsbuffer_ncpy(event->outbound, buf, render_part_header(buf, 256, boundary, type, &ranges[i], file_size));
+    queue_file(event, hsfile_get(file), ranges[i].first, ranges[i].last - ranges[i].first + 1);
+  }
+  snprintf(buf, 256, "\r\n--%s--\r\n", boundary);
+  hsbuffer_ncpy(event->outbound, buf, strlen(buf));
+  hsfile_put(file);
+}
+
+/**
+ * @brief Return whether the quality value after a content coding, e.g. ";q=0.5", is not zero.
+ */
+static int quality_nonzero(const char *params, size_t length) {
+  for (size_t i = 0; i + 1 < length; i++) {
+    if ((params[i] | 0x20) == 'q' && params[i + 1] == '=') {
+      for (i += 2; i < length && params[i] != ';'; i++) {
+        if (params[i] >= '1' && params[i] <= '9') {
+          return 1;
+        }
+      }
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Parse Accept-Encoding.
+ * 
+ * @return The bits of the indexes of content_coding[] that the client accepts.
+ */
+static unsigned accepted_codings(struct hsrequest *request) {
+  const struct hsrequest_header *header = hsrequest_get(request, HSHEADER_ACCEPT_ENCODING);
+  if (!header) {
+    return 0;
+  }
+  const char *value = hsrequest_ptr(request, header->value);
+  size_t length = header->value.length;
+  unsigned accepted = 0, listed = 0, any = 0;
+  size_t pos = 0;
+  while (pos < length) {
+    if (value[pos] == ' ' || value[pos] == '\t' || value[pos] == ',') {
+      pos++;
+      continue;
+    }
+    size_t start = pos;
+    while (pos < length && value[pos] != ',' && value[pos] != ';' && value[pos] != ' ' && value[pos] != '\t') {
+      pos++;
+    }
+    size_t name_length = pos - start;
+    size_t params = pos;
+    while (pos < length && value[pos] != ',') {
+      pos++;
+    }
+    int nonzero = quality_nonzero(value + params, pos - params);
+    if (name_length == 1 && value[start] == '*') {
+      any = nonzero;
+      continue;
+    }
+    for (unsigned i = 0; i < 3; i++) {
+      if (strlen(content_coding[i]) == name_length && !strncasecmp(value + start, content_coding[i], name_length)) {
+        listed |= 1u << i;
+        accepted |= nonzero ? 1u << i : 0;
+      }
+    }
+  }
+  /* "*" covers the codings that are not listed */
+  return any ? accepted | (7u & ~listed) : accepted;
+}
+
+/**
+ * @brief Replace file with a precompressed sidecar next to it, e.g. index.html.br, that the client accepts.
+ * 
+ * @param[in] accepted The bits of the content codings that the client accepts.
+ * @param[out] encoding Set to the content coding if a sidecar is chosen.
+ * 
+ * @return The reference to the file to send, the reference to file is dropped if a sidecar is chosen.
+ */
+static struct hsfile* find_sidecar(struct hsevent *event, unsigned accepted, struct hsfile *file, 
+                                   const char **encoding) {
+  struct hsevent_base *base = event->event_base;
+  for (int i = 0; i < 3 && accepted; i++) {
+    if (!(accepted & (1u << i))) {
+      continue;
+    }
+    struct hsfile *sidecar = hsfcache_open_variant(base ? base->files : NULL, file, i, coding_suffix[i], 
+                                                   base ? base->now : 0);
+    /* A sidecar older than the file has not been regenerated */
+    if (sidecar && sidecar->st.st_mtime >= file->st.st_mtime) {
+      hsfile_put(file);
+      *encoding = content_coding[i];
+      return sidecar;
+    }
+    hsfile_put(sidecar);
+  }
+  return file;
+}
+
+#define CODING_GZIP 2  // The index of gzip in content_coding[]
+
+/**
+ * @brief Replace file with the compressed copy kept by the file cache, compressing file if it is the first time.
+ * 
+ * @return The reference to the file to send, the reference to file is dropped if the copy is chosen.
+ */
+static struct hsfile* compress_file(struct hsevent *event, struct hsfile *file, const char **encoding) {
+  size_t size = (size_t)file->st.st_size;
+  struct hsfcache *cache = event->event_base ? event->event_base->files : NULL;
+  if (!file->compress_tried && cache && file->cached && size >= HSGZIP_MIN && size <= HSGZIP_MAX) {
+    char *contents = file->data;
+    if (!contents && (contents = (char*)malloc(size)) && pread(file->fd, contents, size, 0) != (ssize_t)size) {
+      free(contents);
+      contents = NULL;
+    }
+    if (contents) {
+      char *compressed = NULL;
+      size_t length = hsgzip_compress(contents, size, &compressed);
+      hsfcache_set_compressed(cache, file, compressed, length, "gz");
+      if (contents != file->data) {
+        free(contents);
+      }
+    }
+  }
+  if (!file->compressed) {
+    return file;
+  }
+  struct hsfile *copy = hsfile_get(file->compressed);
+  hsfile_put(file);
+  *encoding = content_coding[CODING_GZIP];
+  return copy;
+}
+
+static void response_get(struct hsevent *event, struct hsrequest *request) {
+  if (response_cgi(event, request)) {
+    return ;
+  }
+  struct hsfile *file = find_file(event, request);
+  if (!file) {
+    response_server_conn(event, request);
+    response_ending(event);
+    return ;
+  }
+  const char *encoding = NULL;
+  if (is_negotiable(request)) {
+    unsigned accepted = accepted_codings(request);
+    file = find_sidecar(event, accepted, file, &encoding);
+    if (!encoding && (accepted & (1u << CODING_GZIP))) {
+      file = compress_file(event, file, &encoding);
+    }
+  }
+  if (is_not_modified(request, file)) {
+    response_not_modified(event, request, file, encoding);
+    return ;
+  }
+  const struct hsrequest_header *range = hsrequest_get(request, HSHEADER_RANGE);
+  if (range && if_range_matches(request, file)) {
+    struct hsrange ranges[HSRANGE_MAX];
+    int count = hsrange_parse(hsrequest_ptr(request, range->value), range->value.length, 
+                              (uint64_t)file->st.st_size, ranges, HSRANGE_MAX);
+    if (count >= 0) {
+      response_ranges(event, request, file, encoding, ranges, count);
+      return ;
+    }
+  }
+  response_file_headers(event, request, file, encoding);
+  hslog_log(event->remote, request, 200, (int)file->st.st_size);
+  response_conn(event, request);
+  response_ending(event);
+  queue_file(event, file, 0, (uint64_t)file->st.st_size);
 }
 
-static void response_post(struct hsevent *event, Request *request) {
+static void response_post(struct hsevent *event, struct hsrequest *request) {
   if (response_cgi(event, request)) {
     return ;
   }
@@ -317,7 +815,7 @@ static void response_post(struct hsevent *event, Request *request) {
   response_ending(event);
 }
 
-static void response_other_method(struct hsevent *event, Request *request) {
+static void response_other_method(struct hsevent *event, struct hsrequest *request) {
   hsbuffer_ncpy(event->outbound, not_implemented, strlen(not_implemented));
   response_server_conn(event, request);
   hsbuffer_ncpy(event->outbound, "Content-length: 0\r\n", 19);
@@ -325,19 +823,19 @@ static void response_other_method(struct hsevent *event, Request *request) {
   hslog_log(event->remote, request, 501, 0);
 }
 
-static void response_method(struct hsevent *event, Request *request, int *fd, size_t *length) {
-  if (!strcmp(request->http_method, "GET")) {
-    response_get(event, request, fd, length);
-  } else if (!strcmp(request->http_method, "HEAD")) {
-    response_head(event, request, fd, length);
-  } else if (!strcmp(request->http_method, "POST")) {
+static void response_method(struct hsevent *event, struct hsrequest *request) {
+  if (hsslice_equal(request, request->method, "GET")) {
+    response_get(event, request);
+  } else if (hsslice_equal(request, request->method, "HEAD")) {
+    response_head(event, request);
+  } else if (hsslice_equal(request, request->method, "POST")) {
     response_post(event, request);
   } else {
     response_other_method(event, request);
   }
 }
 
-static void response_invalid(struct hsevent *event, Request *request) {
+static void response_invalid(struct hsevent *event, struct hsrequest *request) {
   hsbuffer_ncpy(event->outbound, bad_request, strlen(bad_request));
   response_server_conn(event, request);
   hsbuffer_ncpy(event->outbound, "Content-length: 0\r\n", 19);
@@ -345,42 +843,67 @@ static void response_invalid(struct hsevent *event, Request *request) {
   hslog_log(event->remote, request, 400, 0);
 }
 
+static void response_too_large(struct hsevent *event) {
+  hsbuffer_ncpy(event->outbound, too_large, strlen(too_large));
+  response_server_conn(event, NULL);
+  hsbuffer_ncpy(event->outbound, "Content-length: 0\r\n", 19);
+  response_ending(event);
+  hslog_log(event->remote, NULL, 431, 0);
+}
+
 /**
- * @return 1 means a entity of the required length has been detected, and 0 means not yet.
+ * @brief Hand the bytes of the body in inbound to the handler of the request.
  */
-static int fetch_entitybody(struct hsevent *event, Request *request) {
-  if (request) {
-    for (int i = 0; i < request->header_count; i++) {
-      if (!strcmp(request->headers[i].header_name, "Content-length")) {
-        cur_entity_length = atoi(request->headers[i].header_value);
-        break;
-      }
-    }
-  }
-  int readable = (int)hsbuffer_readable(event->inbound);
-  int need = cur_entity_length - fetched_entity_length;
-  fetched_entity_length += (readable > need ? need : readable);
-  if (fetched_entity_length == cur_entity_length) {
-    return 1;
-  } else {
-    return 0;
+static void read_body(struct hsevent *event) {
+  ssize_t bytes_used = hsbody_feed(&event->body, hsbuffer_pos(event->inbound, READ_POS), 
+                                   hsbuffer_readable(event->inbound));
+  if (bytes_used < 0) {
+    /* The response has been generated, but the next request can not be found */
+    event->closed = 1;
+    hsbuffer_consume(event->inbound, hsbuffer_readable(event->inbound));
+    return ;
   }
+  hsbuffer_consume(event->inbound, (size_t)bytes_used);
 }
 
-int create_response(struct hsevent *event, int *fd, size_t *file_length) {
-  Request *request;
-  int size = (int)hsbuffer_readable(event->inbound);
-  int result = parse(hsbuffer_pos(event->inbound, READ_POS), &size, &request);
-  hsbuffer_consume(event->inbound, (size_t)size);
+int create_response(struct hsevent *event) {
+  if (!hsbody_done(&event->body)) {
+    /* The rest of the body of the last request comes before the next request */
+    read_body(event);
+    if (!hsbody_done(&event->body)) {
+      return HSPARSE_INCOMPLETE;
+    }
+  }
+
+  struct hsrequest request;
+  int result = hsrequest_parse(&request, &event->parser, 
+                               hsbuffer_pos(event->inbound, READ_POS), hsbuffer_readable(event->inbound));
+  if (result == HSPARSE_INCOMPLETE) {
+    if (hsbuffer_readable(event->inbound) >= HSEVENT_INBOUND_MAX) {
+      /* inbound is full and can not grow, the rest of the headers will never fit */
+      response_too_large(event);
+      event->unread = 0;  // The connection is closed after the response
+      hsbuffer_consume(event->inbound, hsbuffer_readable(event->inbound));
+      hsparser_init(&event->parser);
+      return HSPARSE_INVALID;
+    }
+    return result;
+  }
+  /* The request still lives in the consumed bytes until the next hsbuffer_recv() */
+  hsbuffer_consume(event->inbound, request.length);
   if (result == HSPARSE_VALID) {
-    if (!response_badversion(event, request)) {
-      if (fetch_entitybody(event, request)) {
-        response_method(event, request, fd, file_length);
-      }
+    if (hsbody_start(&event->body, &request) < 0) {
+      /* Where the body ends is unknown, so the connection can not be reused */
+      response_invalid(event, &request);
+      event->closed = 1;
+      return HSPARSE_INVALID;
+    }
+    if (!response_badversion(event, &request)) {
+      response_method(event, &request);
     }
-    parse_free(request);
+    read_body(event);
   } else if (result == HSPARSE_INVALID) {
-    response_invalid(event, request);
+    response_invalid(event, NULL);
   } 
 
   return result;
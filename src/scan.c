@@ -0,0 +1,225 @@
+/**
+ * @file scan.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ */
+
+#include "scan.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HSSCAN_X86
+#include <immintrin.h>
+#endif
+
+#define V HSSCAN_VALUE
+#define U (HSSCAN_VALUE | HSSCAN_URI)
+#define T (HSSCAN_VALUE | HSSCAN_URI | HSSCAN_TOKEN)
+
+const uint8_t hsscan_class[256] = {
+  ['\t'] = V, [' '] = V,
+  ['!'] = T, ['"'] = U, ['#' ... '\''] = T, ['('] = U, [')'] = U, ['*'] = T, ['+'] = T,
+  [','] = U, ['-'] = T, ['.'] = T, ['/'] = U, ['0' ... '9'] = T, [':' ... '@'] = U,
+  ['A' ... 'Z'] = T, ['['] = U, ['\\'] = U, [']'] = U, ['^' ... 'z'] = T,
+  ['{'] = U, ['|'] = T, ['}'] = U, ['~'] = T,
+  [0x80 ... 0xff] = U
+};
+
+#undef V
+#undef U
+#undef T
+
+static size_t headers_end_scalar(const char *buffer, size_t size, size_t start) {
+  size_t i = start + 3;  // The last \n of an empty line starting at start
+  while (i < size) {
+    const char *lf = (const char*)memchr(buffer + i, '\n', size - i);
+    if (!lf) {
+      return 0;
+    }
+    i = lf - buffer;
+    if (buffer[i - 1] == '\r' && buffer[i - 2] == '\n' && buffer[i - 3] == '\r') {
+      return i + 1;
+    }
+    i++;
+  }
+  return 0;
+}
+
+static size_t skip_scalar(const char *buffer, size_t pos, size_t end, int flags) {
+  while (pos < end && (hsscan_class[(uint8_t)buffer[pos]] & flags)) {
+    pos++;
+  }
+  return pos;
+}
+
+#ifdef HSSCAN_X86
+
+/*
+ * A class is checked 16 or 32 bytes at a time with two shuffles:
+ * nibble_bits[flags][lo] has bit hi set if the byte (hi << 4 | lo) < 0x80 is in the class,
+ * and bytes >= 0x80 are either all in the class or all out of it.
+ */
+static uint8_t nibble_bits[HSSCAN_URI + 1][16];
+
+static const uint8_t hi_bits[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+static void nibble_bits_init() {
+  for (int flags = HSSCAN_TOKEN; flags <= HSSCAN_URI; flags <<= 1) {
+    for (int c = 0; c < 0x80; c++) {
+      if (hsscan_class[c] & flags) {
+        nibble_bits[flags][c & 0x0f] |= (uint8_t)(1 << (c >> 4));
+      }
+    }
+  }
+}
+
+__attribute__((target("sse4.2")))
+static size_t headers_end_sse42(const char *buffer, size_t size, size_t start) {
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  size_t i = start;
+  while (i + 3 + 16 <= size) {
+    /* Byte j of the mask is set if \r\n\r\n starts at i + j */
+    __m128i m = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buffer + i)), cr);
+    m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buffer + i + 1)), lf));
+    m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buffer + i + 2)), cr));
+    m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buffer + i + 3)), lf));
+    int mask = _mm_movemask_epi8(m);
+    if (mask) {
+      return i + __builtin_ctz(mask) + 4;
+    }
+    i += 16;
+  }
+  return headers_end_scalar(buffer, size, i);
+}
+
+__attribute__((target("sse4.2")))
+static size_t skip_sse42(const char *buffer, size_t pos, size_t end, int flags) {
+  if (flags != HSSCAN_TOKEN) {
+    /* The bytes out of the value and URI classes fit in the ranges of pcmpestri */
+    static const char value_ranges[16] = "\x00\x08\x0a\x1f\x7f\x7f";
+    static const char uri_ranges[16] = "\x00\x20\x7f\x7f";
+    const __m128i ranges = _mm_loadu_si128((const __m128i*)(flags == HSSCAN_VALUE ? value_ranges : uri_ranges));
+    int num_of_ranges = flags == HSSCAN_VALUE ? 6 : 4;
+    while (pos + 16 <= end) {
+      __m128i b = _mm_loadu_si128((const __m128i*)(buffer + pos));
+      int index = _mm_cmpestri(ranges, num_of_ranges, b, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES);
+      if (index != 16) {
+        return pos + index;
+      }
+      pos += 16;
+    }
+    return skip_scalar(buffer, pos, end, flags);
+  }
+
+  const __m128i table = _mm_loadu_si128((const __m128i*)nibble_bits[flags]);
+  const __m128i bits = _mm_loadu_si128((const __m128i*)hi_bits);
+  const __m128i low_nibble = _mm_set1_epi8(0x0f);
+  while (pos + 16 <= end) {
+    __m128i b = _mm_loadu_si128((const __m128i*)(buffer + pos));
+    __m128i row = _mm_shuffle_epi8(table, _mm_and_si128(b, low_nibble));
+    __m128i bit = _mm_shuffle_epi8(bits, _mm_and_si128(_mm_srli_epi16(b, 4), low_nibble));
+    /* Bytes >= 0x80 get no bit, they are not tokens */
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(row, bit), _mm_setzero_si128()));
+    if (mask) {
+      return pos + __builtin_ctz(mask);
+    }
+    pos += 16;
+  }
+  return skip_scalar(buffer, pos, end, flags);
+}
+
+__attribute__((target("avx2")))
+static size_t headers_end_avx2(const char *buffer, size_t size, size_t start) {
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  size_t i = start;
+  while (i + 3 + 32 <= size) {
+    __m256i m = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buffer + i)), cr);
+    m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buffer + i + 1)), lf));
+    m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buffer + i + 2)), cr));
+    m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(buffer + i + 3)), lf));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(m);
+    if (mask) {
+      return i + __builtin_ctz(mask) + 4;
+    }
+    i += 32;
+  }
+  /* Not the SSE kernel, mixing legacy SSE and AVX instructions stalls the pipeline */
+  return headers_end_scalar(buffer, size, i);
+}
+
+__attribute__((target("avx2")))
+static size_t skip_avx2(const char *buffer, size_t pos, size_t end, int flags) {
+  const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)nibble_bits[flags]));
+  const __m256i bits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)hi_bits));
+  const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+  /* Bytes >= 0x80 are in the value and URI classes, but not in the token class */
+  const __m256i high_out_of_class = _mm256_set1_epi8(flags == HSSCAN_TOKEN ? -1 : 0);
+  while (pos + 32 <= end) {
+    __m256i b = _mm256_loadu_si256((const __m256i*)(buffer + pos));
+    __m256i row = _mm256_shuffle_epi8(table, _mm256_and_si256(b, low_nibble));
+    __m256i bit = _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(b, 4), low_nibble));
+    __m256i out_of_class = _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), _mm256_setzero_si256());
+    out_of_class = _mm256_blendv_epi8(out_of_class, high_out_of_class, b);  // Selected by the high bit of b
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(out_of_class);
+    if (mask) {
+      return pos + __builtin_ctz(mask);
+    }
+    pos += 32;
+  }
+  return skip_scalar(buffer, pos, end, flags);
+}
+
+#endif  // HSSCAN_X86
+
+static size_t (*headers_end_impl)(const char*, size_t, size_t) = headers_end_scalar;
+static size_t (*skip_impl)(const char*, size_t, size_t, int) = skip_scalar;
+static int selected = HSSCAN_SCALAR;
+
+int hsscan_select(int level) {
+  headers_end_impl = headers_end_scalar;
+  skip_impl = skip_scalar;
+  selected = HSSCAN_SCALAR;
+#ifdef HSSCAN_X86
+  __builtin_cpu_init();
+  if (level >= HSSCAN_AVX2 && __builtin_cpu_supports("avx2")) {
+    headers_end_impl = headers_end_avx2;
+    skip_impl = skip_avx2;
+    selected = HSSCAN_AVX2;
+  } else if (level >= HSSCAN_SSE42 && __builtin_cpu_supports("sse4.2")) {
+    headers_end_impl = headers_end_sse42;
+    skip_impl = skip_sse42;
+    selected = HSSCAN_SSE42;
+  }
+#else
+  (void)level;
+#endif
+  return selected;
+}
+
+/**
+ * @brief Select the best kernels before main() runs.
+ */
+__attribute__((constructor))
+static void hsscan_init() {
+#ifdef HSSCAN_X86
+  nibble_bits_init();
+#endif
+  hsscan_select(HSSCAN_AVX2);
+}
+
+const char* hsscan_name() {
+  static const char *names[] = { "scalar", "sse4.2", "avx2" };
+  return names[selected];
+}
+
+size_t hsscan_headers_end(const char *buffer, size_t size, size_t start) {
+  return headers_end_impl(buffer, size, start);
+}
+
+size_t hsscan_skip(const char *buffer, size_t pos, size_t end, int flags) {
+  return skip_impl(buffer, pos, end, flags);
+}
@@ -0,0 +1,156 @@
+/**
+ * @file timer.c
+ * @author Quan.Dashuai
+ * @version 1.0
+ * @copyright GNU AFFERO GENERAL PUBLIC LICENSE Version3
+ */
+
+#include "timer.h"
+
+#include <stddef.h>
+#include <time.h>
+
+#define HSTIMER_MASK (HSTIMER_SLOTS - 1)
+
+uint64_t hstimer_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void timer_link(struct hstimer *head, struct hstimer *timer) {
+  timer->prev = head->prev;
+  timer->next = head;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+static void timer_unlink(struct hstimer *timer) {
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->prev = timer->next = NULL;
+}
+
+/**
+ * @brief Put the timer into the slot according to the distance to its expiration time.
+ */
+static void timer_place(struct hstimer_wheel *wheel, struct hstimer *timer) {
+  uint64_t delta = timer->expire - wheel->now;
+  int level = 0;
+  while (level < HSTIMER_LEVELS - 1 && delta >> (HSTIMER_BITS * (level + 1))) {
+    level++;
+  }
+  if (delta >> (HSTIMER_BITS * HSTIMER_LEVELS)) {
+    // Beyond the range of the wheel, wait in the farthest slot
+    timer->expire = wheel->now + ((uint64_t)1 << (HSTIMER_BITS * HSTIMER_LEVELS)) - 1;
+  }
+  int index = (timer->expire >> (HSTIMER_BITS * level)) & HSTIMER_MASK;
+  timer_link(&wheel->slots[level][index], timer);
+}
+
+/**
+ * @return The index of the slot that has been cascaded.
+ */
+static int timer_cascade(struct hstimer_wheel *wheel, int level) {
+  int index = (wheel->now >> (HSTIMER_BITS * level)) & HSTIMER_MASK;
+  struct hstimer *head = &wheel->slots[level][index];
+  struct hstimer list;
+  if (head->next == head) {
+    return index;
+  }
+
+  /* Move the whole slot to a temporary list, then place them again */
+  list.next = head->next;
+  list.prev = head->prev;
+  list.next->prev = &list;
+  list.prev->next = &list;
+  head->next = head->prev = head;
+  while (list.next != &list) {
+    struct hstimer *timer = list.next;
+    timer_unlink(timer);
+    timer_place(wheel, timer);
+  }
+  return index;
+}
+
+void hstimer_wheel_init(struct hstimer_wheel *wheel, uint64_t now_ms) {
+  for (int i = 0; i < HSTIMER_LEVELS; i++) {
+    for (int j = 0; j < HSTIMER_SLOTS; j++) {
+      wheel->slots[i][j].prev = wheel->slots[i][j].next = &wheel->slots[i][j];
+    }
+  }
+  wheel->now = now_ms / HSTIMER_TICK;
+  wheel->num_of_timers = 0;
+}
+
+void hstimer_init(struct hstimer *timer, hstimer_cb cb, void *data) {
+  timer->prev = timer->next = NULL;
+  timer->expire = 0;
+  timer->cb = cb;
+  timer->data = data;
+}
+
+void hstimer_add(struct hstimer_wheel *wheel, struct hstimer *timer, uint64_t timeout_ms) {
+  if (hstimer_pending(timer)) {
+    timer_unlink(timer);
+    wheel->num_of_timers--;
+  }
+  uint64_t ticks = (timeout_ms + HSTIMER_TICK - 1) / HSTIMER_TICK;
+  timer->expire = wheel->now + (ticks ? ticks : 1);
+  timer_place(wheel, timer);
+  wheel->num_of_timers++;
+}
+
+void hstimer_del(struct hstimer_wheel *wheel, struct hstimer *timer) {
+  if (hstimer_pending(timer)) {
+    timer_unlink(timer);
+    wheel->num_of_timers--;
+  }
+}
+
+int hstimer_pending(const struct hstimer *timer) {
+  return timer->next != NULL;
+}
+
+void hstimer_wheel_advance(struct hstimer_wheel *wheel, uint64_t now_ms) {
+  uint64_t target = now_ms / HSTIMER_TICK;
+  if (!wheel->num_of_timers) {
+    wheel->now = (target > wheel->now ? target : wheel->now);
+    return ;
+  }
+  while (wheel->now < target) {
+    wheel->now++;
+    for (int level = 1; level < HSTIMER_LEVELS; level++) {
+      if (wheel->now & (((uint64_t)1 << (HSTIMER_BITS * level)) - 1)) {
+        break;
+      }
+      timer_cascade(wheel, level);
+    }
+
+    struct hstimer *head = &wheel->slots[0][wheel->now & HSTIMER_MASK];
+    while (head->next != head) {
+      struct hstimer *timer = head->next;
+      timer_unlink(timer);
+      wheel->num_of_timers--;
+      timer->cb(timer);
+    }
+  }
+}
+
+int hstimer_wheel_timeout(const struct hstimer_wheel *wheel, uint64_t now_ms) {
+  if (!wheel->num_of_timers) {
+    return -1;
+  }
+  uint64_t ticks;
+  for (ticks = 1; ticks < HSTIMER_SLOTS; ticks++) {
+    const struct hstimer *head = &wheel->slots[0][(wheel->now + ticks) & HSTIMER_MASK];
+    if (head->next != head) {
+      break;
+    }
+    if (((wheel->now + ticks) & HSTIMER_MASK) == 0) {
+      break;  // Upper levels cascade at this tick
+    }
+  }
+  uint64_t expire_ms = (wheel->now + ticks) * HSTIMER_TICK;
+  return expire_ms > now_ms ? (int)(expire_ms - now_ms) : 0;
+}
@@ -6,7 +6,10 @@
  */
 
 #include "utils.h"
+#include "event.h"
+#include "filecache.h"
 #include "log.h"
+#include "outq.h"
 #include "response.h"
 
 #include <stdio.h>
@@ -14,12 +17,17 @@
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <assert.h>
 
 int http_port = -1;
 int https_port = -1;
+int num_workers = 1;
+size_t cache_size = HSFCACHE_BUDGET;
+int send_mode = HSOUTQ_LATENCY;
+int idle_timeout = HSINTERVAL;
 
 static void print_help() {
   printf("Usage: ./server [options]\n");
@@ -29,6 +37,10 @@ static void print_help() {
   printf("  --log   %s\n", "File to send log messages to (debug, info, error).");
   printf("  --www   %s\n", "Folder containing a tree to serve as the root of a website.");
   printf("  --cgi   %s\n", "File that should be a script where you redirect all /cgi/* URIs.");
+  printf("  --workers %s\n", "Number of worker processes, each with its own event loop.");
+  printf("  --cache %s\n", "Bytes of small files kept in memory by each worker, 0 disables it.");
+  printf("  --send  %s\n", "latency (default) sends every response at once, throughput corks long ones.");
+  printf("  --timeout %s\n", "Seconds a connection may neither send nor receive before it is closed.");
 }
 
 static void get_port(int server_type, const char *argument) {
@@ -55,11 +67,22 @@ void process_argument(const char *option, const char *argument) {
   } else if (!strcmp(option, "cgi")) {
     strncpy(cgi_folder, argument, 127);
     cgifolder_length = strlen(cgi_folder);
+  } else if (!strcmp(option, "workers")) {
+    num_workers = MAX(atoi(argument), 1);
+  } else if (!strcmp(option, "cache")) {
+    cache_size = strtoull(argument, NULL, 10);
+  } else if (!strcmp(option, "send")) {
+    send_mode = strcmp(argument, "throughput") ? HSOUTQ_LATENCY : HSOUTQ_THROUGHPUT;
+  } else if (!strcmp(option, "timeout")) {
+    idle_timeout = MAX(atoi(argument), 1);
   }
 }
 
 int hssocket(int port) {
   int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(int));
+  setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(int));
   struct sockaddr_in servaddr;
   memset(&servaddr, 0, sizeof(struct sockaddr_in));
   servaddr.sin_family = AF_INET;
@@ -76,6 +99,11 @@ void set_nonblocking(int sockfd) {
   fcntl(sockfd, F_SETFL, val | O_NONBLOCK);
 }
 
+void set_nodelay(int sockfd) {
+  int on = 1;
+  setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(int));
+}
+
 void convertstr(char *str) {
   for (int i = 0; str[i] != '\0'; i++) {
     if (str[i] >= 'a' && str[i] <= 'z') {
@@ -0,0 +1,44 @@
+#include "arena.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+int main() {
+  struct hsarena arena;
+  hsarena_init(&arena, 64);
+
+  /* Nothing is allocated before the first allocation */
+  assert(!arena.chunk);
+
+  /* Allocations are aligned and do not overlap */
+  char *str = hsarena_strndup(&arena, "Host: www.w3.org", 4);
+  assert(!strcmp(str, "Host"));
+  long *number = (long*)hsarena_alloc(&arena, sizeof(long));
+  assert(((uintptr_t)number % _Alignof(max_align_t)) == 0);
+  assert((char*)number >= str + 5);
+  *number = 42;
+  assert(!strcmp(str, "Host"));
+
+  /* The first chunk is full, a new one is started */
+  struct hsarena_chunk *first = arena.chunk;
+  char *block = (char*)hsarena_alloc(&arena, 64);
+  assert(block);
+  assert(arena.chunk != first);
+  memset(block, 'a', 64);
+  assert(*number == 42);
+
+  /* Allocations larger than a chunk */
+  char *large = (char*)hsarena_alloc(&arena, HSARENA_CHUNK * 4);
+  assert(large);
+  memset(large, 'b', HSARENA_CHUNK * 4);
+
+  /* The arena can be used again after it is freed */
+  hsarena_free(&arena);
+  assert(!arena.chunk);
+  str = hsarena_strndup(&arena, "", 0);
+  assert(str && !*str);
+  hsarena_free(&arena);
+
+  return 0;
+}
@@ -0,0 +1,90 @@
+#include "body.h"
+
+#include <assert.h>
+#include <string.h>
+
+static char received[256];
+static size_t received_length;
+static int ended;
+
+static void sink(void *ctx, const char *data, size_t size) {
+  (void)ctx;
+  if (!data) {
+    ended++;
+    return ;
+  }
+  memcpy(received + received_length, data, size);
+  received_length += size;
+}
+
+/**
+ * @brief Start reading the body of the request headers in str.
+ */
+static int start(struct hsbody *body, struct hsrequest *request, const char *str) {
+  assert(hsrequest_parse(request, NULL, str, strlen(str)) == HSPARSE_VALID);
+  received_length = 0;
+  ended = 0;
+  int result = hsbody_start(body, request);
+  body->sink = sink;
+  return result;
+}
+
+int main() {
+  struct hsbody body;
+  struct hsrequest request;
+  hsbody_init(&body);
+  assert(hsbody_done(&body));
+  assert(hsbody_feed(&body, "GET", 3) == 0);
+
+  /* No body */
+  assert(start(&body, &request, "GET / HTTP/1.1\r\nHost: a\r\n\r\n") == 0);
+  assert(hsbody_feed(&body, "GET", 3) == 0);
+  assert(hsbody_done(&body));
+  assert(ended == 1);
+
+  /* Content-Length, the bytes of the next request are left */
+  assert(start(&body, &request, "POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\n") == 0);
+  assert(hsbody_feed(&body, "0123", 4) == 4);
+  assert(!hsbody_done(&body));
+  assert(hsbody_feed(&body, "456789GET", 9) == 6);
+  assert(hsbody_done(&body));
+  assert(received_length == 10 && !memcmp(received, "0123456789", 10));
+  assert(body.received == 10);
+  assert(ended == 1);
+
+  /* Invalid framing */
+  assert(start(&body, &request, "POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n") < 0);
+  assert(start(&body, &request, "POST / HTTP/1.1\r\nContent-Length: \r\n\r\n") < 0);
+  assert(start(&body, &request, "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n") < 0);
+  assert(start(&body, &request, "POST / HTTP/1.1\r\nContent-Length: 1\r\nTransfer-Encoding: chunked\r\n\r\n") < 0);
+
+  /* Chunked, byte by byte */
+  const char *chunked = "5;name=value\r\nhello\r\nA\r\n, chunked!\r\n0\r\nX-Trailer: 1\r\n\r\nGET";
+  assert(start(&body, &request, "POST / HTTP/1.1\r\ntransfer-encoding: Chunked\r\n\r\n") == 0);
+  size_t i = 0;
+  while (!hsbody_done(&body)) {
+    assert(i < strlen(chunked));
+    assert(hsbody_feed(&body, chunked + i, 1) == 1);
+    i++;
+  }
+  assert(!strcmp(chunked + i, "GET"));
+  assert(received_length == 15 && !memcmp(received, "hello, chunked!", 15));
+  assert(ended == 1);
+
+  /* Chunked, at once */
+  assert(start(&body, &request, "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n") == 0);
+  assert(hsbody_feed(&body, chunked, strlen(chunked)) == (ssize_t)strlen(chunked) - 3);
+  assert(hsbody_done(&body));
+  assert(received_length == 15);
+
+  /* Malformed chunks */
+  const char *malformed[] = { "\r\n", "x\r\n", "5\r\nhello0\r\n\r\n", "5\nhello\r\n0\r\n\r\n", "10000000000000000\r\n" };
+  for (i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+    assert(start(&body, &request, "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n") == 0);
+    assert(hsbody_feed(&body, malformed[i], strlen(malformed[i])) < 0);
+    assert(hsbody_done(&body));
+    assert(ended == 1);
+  }
+
+  return 0;
+}
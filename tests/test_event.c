@@ -24,7 +24,10 @@ void close_conn(struct hsevent *event) {
 }
 
 void echo(struct hsevent *event) {
-  hsbuffer_recv(event->sockfd, event->inbound, HS_BUFFER_SIZE);
+  /* EPOLLIN is dispatched before EPOLLRDHUP, the peer may have closed the connection */
+  if (hsbuffer_recv(event->sockfd, event->inbound, HS_BUFFER_SIZE) == 0) {
+    return ;
+  }
   assert(hsbuffer_length(event->inbound) != 0);
   hsbuffer_send(event->sockfd, event->inbound, HS_BUFFER_SIZE);
   assert(hsbuffer_length(event->inbound) == 0);
@@ -0,0 +1,160 @@
+#include "filecache.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void write_file(const char *path, const char *content) {
+  FILE *fp = fopen(path, "w");
+  assert(fp);
+  fputs(content, fp);
+  fclose(fp);
+}
+
+int main() {
+  char paths[3][64];
+  for (int i = 0; i < 3; i++) {
+    snprintf(paths[i], 64, "/tmp/test_filecache_%d_%d", (int)getpid(), i);
+    write_file(paths[i], "hello");
+  }
+
+  struct hsfcache *cache = hsfcache_init(2, 1000, 0);
+  assert(cache);
+
+  /* The second request is served from the cache */
+  struct hsfile *file = hsfcache_open(cache, paths[0], 0);
+  struct hsfile *other;
+  assert(file && file->cached && file->st.st_size == 5);
+  assert(file->etag[0] == '"' && strstr(file->etag, "-5-"));
+  assert(strlen(file->modified) == 29 && !strcmp(file->modified + 25, " GMT"));
+  assert(hsfcache_stats(cache).misses == 1);
+  struct hsfile *again = hsfcache_open(cache, paths[0], 500);
+  assert(again == file);
+  assert(file->refs == 3);
+  assert(hsfcache_stats(cache).hits == 1);
+  hsfile_put(again);
+
+  /* After the TTL an unmodified file is checked and kept */
+  again = hsfcache_open(cache, paths[0], 1500);
+  assert(again == file);
+  assert(hsfcache_stats(cache).checks == 1);
+  hsfile_put(again);
+
+  /* A modified file is reopened, the old one lives until its last reference is dropped */
+  write_file(paths[0], "hello, world");
+  again = hsfcache_open(cache, paths[0], 3000);
+  assert(again != file);
+  assert(!file->cached && file->refs == 1);
+  assert(again->st.st_size == 12);
+  char buf[8];
+  assert(pread(file->fd, buf, 5, 0) == 5);
+  hsfile_put(file);
+  hsfile_put(again);
+
+  /* The least recently used file is evicted */
+  struct hsfile *second = hsfcache_open(cache, paths[1], 3000);
+  hsfile_put(hsfcache_open(cache, paths[0], 3000));
+  struct hsfile *third = hsfcache_open(cache, paths[2], 3000);
+  assert(!second->cached && third->cached);
+  hsfile_put(second);
+  hsfile_put(third);
+
+  /* Errors are not cached */
+  unlink(paths[1]);
+  assert(!hsfcache_open(cache, paths[1], 3000));
+  assert(errno == ENOENT);
+
+  /* Only regular files are cached */
+  file = hsfcache_open(cache, "/tmp", 3000);
+  assert(file && !file->cached);
+  hsfile_put(file);
+
+  /* Without a cache */
+  file = hsfcache_open(NULL, paths[2], 0);
+  assert(file && !file->cached && file->refs == 1);
+  hsfile_put(file);
+
+  /* Files still referenced survive the cache */
+  file = hsfcache_open(cache, paths[2], 3000);
+  hsfcache_free(cache);
+  assert(!file->cached && file->refs == 1);
+  hsfile_put(file);
+
+  /* Variants that do not exist are remembered until the file is checked again */
+  cache = hsfcache_init(4, 1000, 0);
+  file = hsfcache_open(cache, paths[2], 0);
+  assert(!hsfcache_open_variant(cache, file, 1, ".gz", 0));
+  assert(file->missing == 2);
+  char variant[80];
+  snprintf(variant, 80, "%s.gz", paths[2]);
+  write_file(variant, "gz");
+  assert(!hsfcache_open_variant(cache, file, 1, ".gz", 500));
+  hsfile_put(hsfcache_open(cache, paths[2], 1500));
+  assert(file->missing == 0);
+  other = hsfcache_open_variant(cache, file, 1, ".gz", 1500);
+  assert(other && other->cached && other->st.st_size == 2);
+  hsfile_put(other);
+  hsfile_put(file);
+  hsfcache_free(cache);
+  unlink(variant);
+
+  /* Small files are kept in memory within the budget */
+  cache = hsfcache_init(4, 1000, 16);
+  write_file(paths[0], "0123456789");
+  write_file(paths[1], "abcdefghij");
+  file = hsfcache_open(cache, paths[0], 0);
+  assert(file->data && !memcmp(file->data, "0123456789", 10));
+  assert(hsfcache_stats(cache).memory == 10);
+  assert(hsfcache_set_headers(cache, file, "HTTP", 4) == 0);
+  assert(hsfcache_set_headers(cache, file, "HTTP", 4) < 0);
+  assert(file->headers_length == 4 && hsfcache_stats(cache).memory == 14);
+
+  /* Contents still referenced are not released to make room */
+  other = hsfcache_open(cache, paths[1], 0);
+  assert(!other->data && hsfcache_stats(cache).memory == 14);
+  hsfile_put(other);
+  hsfile_put(file);
+
+  /* The least recently used contents are released to make room */
+  write_file(paths[2], "ABCDEFGHIJ");
+  other = hsfcache_open(cache, paths[2], 0);
+  assert(other->data && !memcmp(other->data, "ABCDEFGHIJ", 10));
+  assert(!file->data && file->cached);
+  assert(hsfcache_stats(cache).memory == 10);
+  assert(hsfcache_set_headers(NULL, other, "HTTP", 4) < 0);
+
+  /* A compressed copy shares the budget and lives while a response holds it */
+  char *data = (char*)malloc(4);
+  memcpy(data, "gzip", 4);
+  assert(hsfcache_set_compressed(cache, other, data, 4, "gz") == 0);
+  assert(other->compress_tried && other->compressed->fd == -1 && other->compressed->st.st_size == 4);
+  assert(!strncmp(other->compressed->etag, other->etag, strlen(other->etag) - 1));
+  assert(!strcmp(other->compressed->etag + strlen(other->etag) - 1, "-gz\""));
+  assert(hsfcache_stats(cache).memory == 14);
+  struct hsfile *copy = hsfile_get(other->compressed);
+  hsfile_put(other);
+  write_file(variant, "0123456789");
+  hsfile_put(hsfcache_open(cache, variant, 0));  // Releases the contents of paths[2]
+  assert(!other->compressed && !other->compress_tried && hsfcache_stats(cache).memory == 10);
+  assert(!memcmp(copy->data, "gzip", 4));
+  hsfile_put(copy);
+  assert(hsfcache_set_compressed(cache, other, NULL, 0, "gz") < 0 && other->compress_tried);
+
+  /* Released contents are loaded again on a hit, and headers stay within the budget */
+  assert(hsfcache_open(cache, paths[2], 0) == other);
+  assert(other->data && !memcmp(other->data, "ABCDEFGHIJ", 10));
+  assert(hsfcache_stats(cache).memory == 10);
+  assert(hsfcache_set_headers(cache, other, "HTTP/1.1", 8) < 0);
+  assert(!other->headers && hsfcache_stats(cache).memory == 10);
+  hsfile_put(other);
+  hsfcache_free(cache);
+
+  unlink(variant);
+  unlink(paths[0]);
+  unlink(paths[1]);
+  unlink(paths[2]);
+  return 0;
+}
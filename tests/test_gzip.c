@@ -0,0 +1,45 @@
+#include "gzip.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+int main() {
+  size_t length = 64 * 1024;
+  char *data = (char*)malloc(length);
+  for (size_t i = 0; i < length; i++) {
+    data[i] = "<p>hello, world</p>\n"[i % 20];
+  }
+
+  /* The result is one gzip member that inflates to data */
+  char *compressed = NULL;
+  size_t compressed_length = hsgzip_compress(data, length, &compressed);
+  assert(compressed_length > 0 && compressed_length < length / 10);
+  assert((unsigned char)compressed[0] == 0x1f && (unsigned char)compressed[1] == 0x8b);
+
+  char *inflated = (char*)malloc(length);
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  assert(inflateInit2(&stream, 16 + 15) == Z_OK);
+  stream.next_in = (Bytef*)compressed;
+  stream.avail_in = (uInt)compressed_length;
+  stream.next_out = (Bytef*)inflated;
+  stream.avail_out = (uInt)length;
+  assert(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+  assert(stream.total_out == length && !memcmp(inflated, data, length));
+  inflateEnd(&stream);
+  free(compressed);
+
+  /* Data that does not compress is rejected */
+  srand(1);
+  for (size_t i = 0; i < length; i++) {
+    data[i] = (char)rand();
+  }
+  compressed = NULL;
+  assert(hsgzip_compress(data, length, &compressed) == 0 && !compressed);
+
+  free(inflated);
+  free(data);
+  return 0;
+}
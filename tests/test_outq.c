@@ -0,0 +1,132 @@
+#include "outq.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#define FILE_SIZE (4 * 1024 * 1024)
+
+static int make_file(const char *path, char fill, size_t size) {
+  char *data = (char*)malloc(size);
+  memset(data, fill, size);
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  assert(write(fd, data, size) == (ssize_t)size);
+  free(data);
+  unlink(path);
+  return fd;
+}
+
+int main() {
+  struct hspool *pool = hspool_init();
+  struct hsbuffer *buffer = hsbuffer_init_pool(pool, HS_BUFFER_SIZE);
+  struct hsoutq *queue = hsoutq_init(pool, buffer);
+  assert(queue);
+
+  int sv[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+  fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL, 0) | O_NONBLOCK);
+
+  /* Segments are sent in the order they are added */
+  hsbuffer_ncpy(buffer, "head ", 5);
+  assert(hsoutq_add_static(queue, "static ", 7) == 0);
+  assert(hsoutq_add_copy(queue, "copy ", 5) == 0);
+  assert(hsoutq_add_file(queue, make_file("/tmp/test_outq_small", 's', 4), 0, 4) == 0);
+  assert(hsoutq_add_file(queue, make_file("/tmp/test_outq_large", 'l', FILE_SIZE), 0, FILE_SIZE) == 0);
+  hsbuffer_ncpy(buffer, " tail", 5);
+  assert(hsoutq_pending(queue) == 5 + 7 + 5 + 4 + FILE_SIZE);
+
+  /* The socket blocks in the middle of the file, and the next flush resumes from there */
+  size_t expected = hsoutq_pending(queue) + 5;
+  char *received = (char*)malloc(expected);
+  size_t total = 0;
+  int result;
+  int blocked = 0;
+  while ((result = hsoutq_flush(queue, sv[0], 0)) == 0) {
+    blocked++;
+    ssize_t bytes_read = read(sv[1], received + total, expected - total);
+    assert(bytes_read > 0);
+    total += bytes_read;
+  }
+  assert(result == 1);
+  assert(blocked > 0);
+  assert(hsoutq_pending(queue) == 0);
+  assert(hsbuffer_readable(buffer) == 0);
+  while (total < expected) {
+    ssize_t bytes_read = read(sv[1], received + total, expected - total);
+    assert(bytes_read > 0);
+    total += bytes_read;
+  }
+
+  assert(!memcmp(received, "head static copy ssss", 21));
+  for (size_t i = 21; i < 21 + FILE_SIZE; i++) {
+    assert(received[i] == 'l');
+  }
+  assert(!memcmp(received + 21 + FILE_SIZE, " tail", 5));
+
+  /* A flush stops after the budget, in the middle of the file */
+  assert(hsoutq_add_file(queue, make_file("/tmp/test_outq_budget", 'b', FILE_SIZE), 0, FILE_SIZE) == 0);
+  assert(hsoutq_flush(queue, sv[0], 1000) == 2);
+  assert(hsoutq_pending(queue) == FILE_SIZE - 1000);
+  char chunk[1000];
+  assert(read(sv[1], chunk, 1000) == 1000 && chunk[0] == 'b' && chunk[999] == 'b');
+  total = FILE_SIZE - 1000;
+  while (total > 0) {
+    result = hsoutq_flush(queue, sv[0], 0);
+    assert(result >= 0);
+    ssize_t bytes_read = read(sv[1], received, total);
+    assert(bytes_read > 0);
+    total -= bytes_read;
+  }
+  assert(result == 1 || hsoutq_flush(queue, sv[0], 0) == 1);
+
+  /* Corking is ignored by sockets that are not TCP, the chain is sent unchanged */
+  hsoutq_set_mode(queue, HSOUTQ_THROUGHPUT);
+  hsbuffer_ncpy(buffer, "head ", 5);
+  assert(hsoutq_add_file(queue, make_file("/tmp/test_outq_cork", 'c', 4), 0, 4) == 0);
+  hsbuffer_ncpy(buffer, " tail", 5);
+  assert(hsoutq_flush(queue, sv[0], 0) == 1);
+  assert(read(sv[1], chunk, 1000) == 14 && !memcmp(chunk, "head cccc tail", 14));
+
+  /* A peer that resets in the middle of a file fails the flush, SIGPIPE is ignored as in server.c */
+  signal(SIGPIPE, SIG_IGN);
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  assert(bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+  assert(listen(listener, 1) == 0);
+  assert(getsockname(listener, (struct sockaddr*)&addr, &addrlen) == 0);
+  int client = socket(AF_INET, SOCK_STREAM, 0);
+  assert(connect(client, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+  int peer = accept(listener, NULL, NULL);
+  assert(peer >= 0);
+  fcntl(client, F_SETFL, fcntl(client, F_GETFL, 0) | O_NONBLOCK);
+  hsoutq_set_mode(queue, HSOUTQ_LATENCY);
+  assert(hsoutq_add_file(queue, make_file("/tmp/test_outq_reset", 'r', FILE_SIZE), 0, FILE_SIZE) == 0);
+  assert(hsoutq_flush(queue, client, 1000) == 2);
+  struct linger linger = { 1, 0 };
+  setsockopt(peer, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+  close(peer);
+  while ((result = hsoutq_flush(queue, client, 0)) == 0) {
+  }
+  assert(result == -1);
+  /* Sending again on the reset socket fails with EPIPE, the process survives because SIGPIPE is ignored */
+  assert(hsoutq_flush(queue, client, 0) == -1);
+  close(client);
+  close(listener);
+
+  free(received);
+  close(sv[0]);
+  close(sv[1]);
+  hsoutq_free(queue);
+  hsbuffer_free(buffer);
+  hspool_free(pool);
+  return 0;
+}
@@ -2,6 +2,24 @@
 
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+
+#define NUM_OF_THREADS 4
+
+static void* parse_loop(void *arg) {
+  char *buffer = strdup((const char*)arg);
+  for (int i = 0; i < 20000; i++) {
+    Request *request = NULL;
+    int size = strlen(buffer);
+    assert(parse(buffer, &size, &request) == HSPARSE_VALID);
+    assert(!strcmp(request->http_uri, "/index.html"));
+    assert(request->header_count == 6);
+    assert(!strcmp(find_key(request, "Accept-Language")->header_value, "en-US"));
+    parse_free(request);
+  }
+  free(buffer);
+  return NULL;
+}
 
 int main() {
   Request *request = NULL;
@@ -70,5 +88,47 @@ int main() {
   assert(!size);
   parse_free(request);
 
+  /* The bison parser gives the same result */
+  size = strlen(request_2);
+  parse_result = parse_yacc(request_2, &size, &request);
+  assert(parse_result == HSPARSE_VALID);
+  assert(!strcmp(request->http_method, "GET"));
+  assert(!strcmp(find_key(request, "User-Agent")->header_value, "Mozilla/5.0"));
+  parse_free(request);
+
+  size = strlen(request_3);
+  parse_result = parse_yacc(request_3, &size, &request);
+  assert(parse_result == HSPARSE_INVALID);
+  assert(!request);
+
+  /* Long header fields are not truncated, and any number of them is kept */
+  char long_request[4096] = "GET /index.html HTTP/1.1\r\nCookie: ";
+  memset(long_request + strlen(long_request), 'c', 1000);
+  strcat(long_request, "\r\n");
+  for (int i = 0; i < 20; i++) {
+    strcat(long_request, "X-Header: x\r\n");
+  }
+  strcat(long_request, "\r\n");
+  for (int i = 0; i < 2; i++) {
+    size = strlen(long_request);
+    parse_result = (i == 0 ? parse : parse_yacc)(long_request, &size, &request);
+    assert(parse_result == HSPARSE_VALID);
+    assert(request->header_count == 21);
+    assert(request->headers[0].value_length == 1000);
+    assert(strlen(find_key(request, "cookie")->header_value) == 1000);
+    assert(!strcmp(request->headers[20].header_name, "X-Header"));
+    assert(request->headers[20].name_length == 8);
+    parse_free(request);
+  }
+
+  /* parse() from several threads at once */
+  pthread_t threads[NUM_OF_THREADS];
+  for (int i = 0; i < NUM_OF_THREADS; i++) {
+    assert(!pthread_create(&threads[i], NULL, parse_loop, request_2));
+  }
+  for (int i = 0; i < NUM_OF_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
   return 0;
 }
@@ -0,0 +1,167 @@
+#include "poller.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define STREAM_SIZE (512 * 1024)
+#define CHUNK       (32 * 1024)
+
+static void set_nonblock(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/**
+ * @brief Send at most CHUNK bytes of the rest of the stream, shut down once all is sent.
+ */
+static size_t send_some(int client, const char *out, size_t sent) {
+  size_t length = STREAM_SIZE - sent < CHUNK ? STREAM_SIZE - sent : CHUNK;
+  ssize_t bytes_sent = length ? send(client, out + sent, length, 0) : 0;
+  if (bytes_sent < 0) {
+    return 0;
+  }
+  if (sent + (size_t)bytes_sent == STREAM_SIZE) {
+    shutdown(client, SHUT_WR);
+  }
+  return (size_t)bytes_sent;
+}
+
+/**
+ * @brief Wait until the fd registered with data is ready, return its events.
+ */
+static uint32_t wait_for(struct hspoller *poller, uint64_t data) {
+  struct epoll_event events[16];
+  for (int round = 0; round < 50; round++) {
+    int nready = hspoller_wait(poller, events, 16, 100);
+    uint32_t ready = 0;
+    for (int i = 0; i < nready; i++) {
+      if (events[i].data.u64 == data) {
+        ready |= events[i].events;
+      }
+    }
+    if (ready) {
+      return ready;
+    }
+  }
+  return 0;
+}
+
+int main() {
+  struct hspoller *poller = hspoller_init();
+  assert(poller);
+  printf("backend %s\n", hspoller_name());
+
+  int listen_sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  assert(bind(listen_sockfd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+  assert(listen(listen_sockfd, 16) == 0);
+  assert(getsockname(listen_sockfd, (struct sockaddr*)&addr, &addrlen) == 0);
+  set_nonblock(listen_sockfd);
+  uint64_t listen_data = ((uint64_t)7 << 32) | (uint32_t)listen_sockfd;
+  assert(hspoller_ctl(poller, EPOLL_CTL_ADD, listen_sockfd, EPOLLIN | EPOLLET, listen_data) == 0);
+
+  /* All pending connections are accepted, with the address of the peer */
+  int clients[3];
+  int conns[3];
+  for (int i = 0; i < 3; i++) {
+    clients[i] = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(clients[i], (struct sockaddr*)&addr, sizeof(addr)) == 0);
+  }
+  int accepted = 0;
+  while (accepted < 3) {
+    assert(wait_for(poller, listen_data) & EPOLLIN);
+    while (1) {
+      struct sockaddr_in remote;
+      socklen_t remote_len = sizeof(remote);
+      int conn_sockfd = hspoller_accept(poller, listen_sockfd, (struct sockaddr*)&remote, &remote_len);
+      if (conn_sockfd < 0) {
+        assert(errno == EAGAIN);
+        break;
+      }
+      assert(accepted < 3);
+      assert(remote.sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+      conns[accepted++] = conn_sockfd;
+    }
+  }
+  /* A connection made after the queue was drained is reported again */
+  int late = socket(AF_INET, SOCK_STREAM, 0);
+  assert(connect(late, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+  assert(wait_for(poller, listen_data) & EPOLLIN);
+  int late_conn = hspoller_accept(poller, listen_sockfd, NULL, NULL);
+  assert(late_conn >= 0);
+  close(late_conn);
+  close(late);
+
+  /* A stream that is sometimes not read for a while arrives complete and in order */
+  int conn_sockfd = conns[0];
+  int client = clients[0];
+  int size = 16 * 1024;
+  setsockopt(conn_sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(int));
+  setsockopt(client, SOL_SOCKET, SO_SNDBUF, &size, sizeof(int));
+  set_nonblock(conn_sockfd);
+  set_nonblock(client);
+  uint64_t conn_data = ((uint64_t)9 << 32) | (uint32_t)conn_sockfd;
+  assert(hspoller_ctl(poller, EPOLL_CTL_ADD, conn_sockfd, EPOLLIN | EPOLLET | EPOLLRDHUP, conn_data) == 0);
+  static char out[STREAM_SIZE];
+  static char in[STREAM_SIZE];
+  for (int i = 0; i < STREAM_SIZE; i++) {
+    out[i] = (char)(i % 251);
+  }
+  size_t sent = 0;
+  size_t received = 0;
+  uint32_t ready = EPOLLIN;  // Events reported since the last EAGAIN
+  for (int round = 0; round < 10000 && received < STREAM_SIZE; round++) {
+    struct epoll_event events[16];
+    sent += send_some(client, out, sent);
+    int nready = hspoller_wait(poller, events, 16, 10);
+    for (int i = 0; i < nready; i++) {
+      if (events[i].data.u64 == conn_data) {
+        ready |= events[i].events;
+      }
+    }
+    if (round % 16 >= 8) {
+      continue;  // The readiness is left unconsumed, like a connection whose output is blocked
+    }
+    while (received < STREAM_SIZE) {
+      size_t length = STREAM_SIZE - received < 1000 ? STREAM_SIZE - received : 1000;
+      ssize_t bytes_recv = hspoller_recv(poller, conn_sockfd, in + received, length);
+      if (bytes_recv < 0) {
+        assert(errno == EAGAIN);
+        ready = 0;
+        break;
+      }
+      /* Data that arrives after EAGAIN is always reported */
+      assert(bytes_recv > 0 && (ready & EPOLLIN));
+      received += (size_t)bytes_recv;
+    }
+  }
+  assert(received == STREAM_SIZE);
+  assert(memcmp(in, out, STREAM_SIZE) == 0);
+
+  /* The end of the stream follows the data */
+  char c;
+  ssize_t bytes_recv;
+  while ((bytes_recv = hspoller_recv(poller, conn_sockfd, &c, 1)) < 0) {
+    assert(errno == EAGAIN);
+    assert(wait_for(poller, conn_data) & (EPOLLIN | EPOLLRDHUP));
+  }
+  assert(bytes_recv == 0);
+
+  assert(hspoller_ctl(poller, EPOLL_CTL_DEL, conn_sockfd, 0, 0) == 0);
+  assert(hspoller_ctl(poller, EPOLL_CTL_DEL, listen_sockfd, 0, 0) == 0);
+  for (int i = 0; i < 3; i++) {
+    close(conns[i]);
+    close(clients[i]);
+  }
+  close(listen_sockfd);
+  hspoller_free(poller);
+  return 0;
+}
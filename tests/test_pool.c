@@ -0,0 +1,87 @@
+#include "pool.h"
+#include "buffer.h"
+
+#include <assert.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int main() {
+  struct hspool *pool = hspool_init();
+
+  /* Basic tests */
+  assert(pool);
+  assert(hspool_class_size(1) == 16);
+  assert(hspool_class_size(16) == 16);
+  assert(hspool_class_size(17) == 32);
+  assert(hspool_class_size(8192) == 8192);
+  assert(hspool_class_size(1 << 20) == 1 << 20);
+
+  /* Blocks are recycled within the same class */
+  void *block = hspool_alloc(pool, 100);
+  assert(block);
+  assert(hspool_stats(pool).misses == 1);
+  hspool_put(pool, block, 100);
+  assert(hspool_stats(pool).cached == 128);
+  assert(hspool_alloc(pool, 120) == block);
+  assert(hspool_stats(pool).hits == 1);
+  assert(hspool_stats(pool).cached == 0);
+  hspool_put(pool, block, 120);
+
+  /* Large blocks bypass the free lists */
+  block = hspool_alloc(pool, 1 << 20);
+  assert(block);
+  hspool_put(pool, block, 1 << 20);
+  assert(hspool_stats(pool).cached == 128);
+
+  /* hsbuffer from pool */
+  struct hsbuffer *buffer = hsbuffer_init_pool(pool, HS_BUFFER_SIZE);
+  assert(buffer);
+  assert(hsbuffer_capacity(buffer) == HS_BUFFER_SIZE - 1);
+  hsbuffer_ncpy(buffer, "12345678", 8);
+  hsbuffer_expand(buffer, HS_BUFFER_SIZE * 2);
+  assert(hsbuffer_capacity(buffer) >= HS_BUFFER_SIZE * 2);
+  assert(!strncmp(hsbuffer_pos(buffer, READ_POS), "12345678", 8));
+  hsbuffer_free(buffer);
+
+  /* The space of the consumed bytes is reused after compaction */
+  int sv[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+  assert(write(sv[1], "12345678", 8) == 8);
+  buffer = hsbuffer_init_pool(pool, HS_BUFFER_SIZE);
+  assert(hsbuffer_recv(sv[0], buffer, 8) == 8);
+  hsbuffer_consume(buffer, 4);
+  assert(hsbuffer_remain(buffer) == HS_BUFFER_SIZE - 1 - 8);
+  hsbuffer_compact(buffer);
+  assert(hsbuffer_remain(buffer) == HS_BUFFER_SIZE - 1 - 4);
+  assert(hsbuffer_readable(buffer) == 4);
+  assert(!strcmp(hsbuffer_pos(buffer, READ_POS), "5678"));
+  hsbuffer_free(buffer);
+  close(sv[0]);
+  close(sv[1]);
+
+  /* Data is allocated on first use and released when empty */
+  buffer = hsbuffer_init_pool(pool, HS_BUFFER_SIZE);
+  assert(!hsbuffer_allocated(buffer));
+  assert(hsbuffer_remain(buffer) == HS_BUFFER_SIZE - 1);
+  hsbuffer_ncpy(buffer, "1234", 4);
+  assert(hsbuffer_allocated(buffer));
+  hsbuffer_release(buffer);
+  assert(hsbuffer_allocated(buffer));
+  hsbuffer_consume(buffer, 4);
+  hsbuffer_release(buffer);
+  assert(!hsbuffer_allocated(buffer));
+  assert(hsbuffer_readable(buffer) == 0);
+  hsbuffer_free(buffer);
+
+  struct hspool_stats stats = hspool_stats(pool);
+  buffer = hsbuffer_init_pool(pool, HS_BUFFER_SIZE);
+  assert(hspool_stats(pool).hits == stats.hits + 1);
+  hsbuffer_ncpy(buffer, "1234", 4);
+  assert(hspool_stats(pool).hits == stats.hits + 2);
+  assert(hspool_stats(pool).misses == stats.misses);
+  hsbuffer_free(buffer);
+
+  hspool_free(pool);
+  return 0;
+}
@@ -0,0 +1,55 @@
+#include "range.h"
+
+#include <assert.h>
+#include <string.h>
+
+static int parse(const char *value, uint64_t size, struct hsrange *ranges) {
+  return hsrange_parse(value, strlen(value), size, ranges, HSRANGE_MAX);
+}
+
+int main() {
+  struct hsrange ranges[HSRANGE_MAX];
+
+  /* A single range, clipped to the file */
+  assert(parse("bytes=0-499", 1000, ranges) == 1);
+  assert(ranges[0].first == 0 && ranges[0].last == 499);
+  assert(parse("bytes=500-", 1000, ranges) == 1);
+  assert(ranges[0].first == 500 && ranges[0].last == 999);
+  assert(parse("bytes=900-5000", 1000, ranges) == 1);
+  assert(ranges[0].first == 900 && ranges[0].last == 999);
+  assert(parse("Bytes=0-0", 1000, ranges) == 1);
+  assert(ranges[0].first == 0 && ranges[0].last == 0);
+
+  /* Suffix ranges */
+  assert(parse("bytes=-100", 1000, ranges) == 1);
+  assert(ranges[0].first == 900 && ranges[0].last == 999);
+  assert(parse("bytes=-5000", 1000, ranges) == 1);
+  assert(ranges[0].first == 0 && ranges[0].last == 999);
+
+  /* A list, with whitespace and empty elements */
+  assert(parse("bytes=0-9, 20-29,,-5", 100, ranges) == 3);
+  assert(ranges[1].first == 20 && ranges[1].last == 29);
+  assert(ranges[2].first == 95 && ranges[2].last == 99);
+
+  /* Unsatisfiable ranges are dropped */
+  assert(parse("bytes=0-9,2000-3000", 100, ranges) == 1);
+  assert(parse("bytes=1000-", 1000, ranges) == 0);
+  assert(parse("bytes=-0", 1000, ranges) == 0);
+  assert(parse("bytes=0-", 0, ranges) == 0);
+
+  /* Invalid fields are ignored */
+  assert(parse("items=0-9", 100, ranges) == -1);
+  assert(parse("bytes=", 100, ranges) == -1);
+  assert(parse("bytes=9-0", 100, ranges) == -1);
+  assert(parse("bytes=500-400", 100, ranges) == -1);
+  assert(parse("bytes=-", 100, ranges) == -1);
+  assert(parse("bytes=a-b", 100, ranges) == -1);
+  assert(parse("bytes=0-9;", 100, ranges) == -1);
+  assert(parse("bytes=1234567890123456789-", 100, ranges) == -1);
+
+  /* Too many ranges */
+  assert(parse("bytes=0-0,1-1,2-2,3-3,4-4,5-5,6-6,7-7,8-8,9-9,10-10,11-11,12-12,13-13,14-14,15-15", 100, ranges) == 16);
+  assert(parse("bytes=0-0,1-1,2-2,3-3,4-4,5-5,6-6,7-7,8-8,9-9,10-10,11-11,12-12,13-13,14-14,15-15,16-16", 
+               100, ranges) == -1);
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include "request.h"
+
+#include <string.h>
+#include <assert.h>
+
+int main() {
+  struct hsrequest request;
+  int parse_result;
+
+  /* Valid request */
+  char *request_1 = "GET /index.html HTTP/1.1\r\nHost: www.w3.org\r\nConnection:  Keep-Alive \t\r\n\r\nbody";
+  parse_result = hsrequest_parse(&request, NULL, request_1, strlen(request_1));
+  assert(parse_result == HSPARSE_VALID);
+  assert(request.length == strlen(request_1) - 4);
+  assert(hsslice_equal(&request, request.method, "GET"));
+  assert(hsslice_equal(&request, request.uri, "/index.html"));
+  assert(hsslice_equal(&request, request.version, "HTTP/1.1"));
+  assert(request.header_count == 2);
+  assert(hsslice_equal(&request, request.headers[0].name, "Host"));
+  assert(hsslice_equal(&request, request.headers[0].value, "www.w3.org"));
+  assert(hsslice_equal(&request, hsrequest_find(&request, "Connection")->value, "Keep-Alive"));
+  assert(!hsrequest_find(&request, "Content-length"));
+  assert(!hsrequest_find(NULL, "Host"));
+
+  /* Known header fields, whatever the case */
+  assert(request.headers[0].id == HSHEADER_HOST);
+  assert(hsrequest_get(&request, HSHEADER_CONNECTION) == &request.headers[1]);
+  assert(!hsrequest_get(&request, HSHEADER_CONTENT_LENGTH));
+  assert(hsrequest_find(&request, "CONNECTION") == &request.headers[1]);
+  assert(hsslice_equal_nocase(&request, request.headers[1].value, "keep-alive"));
+  assert(hsheader_id("content-LENGTH", 14) == HSHEADER_CONTENT_LENGTH);
+  assert(hsheader_id("If-None-Match", 13) == HSHEADER_IF_NONE_MATCH);
+  assert(hsheader_id("If-Modified-Since", 17) == HSHEADER_IF_MODIFIED_SINCE);
+  assert(hsheader_id("Transfer-Encoding", 17) == HSHEADER_TRANSFER_ENCODING);
+  assert(hsheader_id("Accept-Language", 15) == HSHEADER_OTHER);
+  assert(hsheader_id("Hos", 3) == HSHEADER_OTHER);
+  assert(hsheader_id("", 0) == HSHEADER_OTHER);
+
+  char *request_2 = "POST /cgi/?a=1 HTTP/1.1\r\nContent-length: 0\r\nX-Empty:\r\n\r\n";
+  parse_result = hsrequest_parse(&request, NULL, request_2, strlen(request_2));
+  assert(parse_result == HSPARSE_VALID);
+  assert(request.length == strlen(request_2));
+  assert(request.headers[1].value.length == 0);
+  assert(request.headers[1].id == HSHEADER_OTHER);
+  assert(hsrequest_find(&request, "x-empty") == &request.headers[1]);
+  assert(!hsrequest_get(&request, HSHEADER_HOST));
+  assert(hsrequest_get(&request, HSHEADER_CONTENT_LENGTH) == &request.headers[0]);
+
+  /* Invalid request */
+  char *request_3 = "GET /index.html HTTP/1.1\rHost: www.w3.org\r\nConnection: close\r\n\r\n";
+  parse_result = hsrequest_parse(&request, NULL, request_3, strlen(request_3));
+  assert(parse_result == HSPARSE_INVALID);
+  assert(request.length == strlen(request_3));
+
+  char *request_4 = "GET /index.html HTTP/1.1\r\r\nHost: www.w3.org\r\nConnection: close\r\n\r\n";
+  parse_result = hsrequest_parse(&request, NULL, request_4, strlen(request_4));
+  assert(parse_result == HSPARSE_INVALID);
+
+  char *request_5 = "GET /index.html HTTP/1.1\r\nHost : www.w3.org\r\n\r\n";
+  parse_result = hsrequest_parse(&request, NULL, request_5, strlen(request_5));
+  assert(parse_result == HSPARSE_INVALID);
+
+  char *request_6 = "G(T /index.html HTTP/1.1\r\n\r\n";
+  parse_result = hsrequest_parse(&request, NULL, request_6, strlen(request_6));
+  assert(parse_result == HSPARSE_INVALID);
+
+  char many[HSREQUEST_MAX_HEADERS * 8 + 64] = "GET / HTTP/1.1\r\n";
+  for (int i = 0; i <= HSREQUEST_MAX_HEADERS; i++) {
+    strcat(many, "A: b\r\n");
+  }
+  strcat(many, "\r\n");
+  parse_result = hsrequest_parse(&request, NULL, many, strlen(many));
+  assert(parse_result == HSPARSE_INVALID);
+
+  /* Incomplete request */
+  char *request_7 = "GET /index.html HTTP/1.1\r\nHost: www.w3.org\r\nConnection: close\r\n\r\r\n";
+  parse_result = hsrequest_parse(&request, NULL, request_7, strlen(request_7));
+  assert(parse_result == HSPARSE_INCOMPLETE);
+
+  char *request_8 = "GET /index.html HTTP/1.1\r\nHost: www.w3.org\r\nConnection: clo";
+  parse_result = hsrequest_parse(&request, NULL, request_8, strlen(request_8));
+  assert(parse_result == HSPARSE_INCOMPLETE);
+
+  /* Headers arriving byte by byte */
+  struct hsparser parser;
+  hsparser_init(&parser);
+  for (size_t i = 1; i < strlen(request_1) - 4; i++) {
+    parse_result = hsrequest_parse(&request, &parser, request_1, i);
+    assert(parse_result == HSPARSE_INCOMPLETE);
+    assert(parser.scanned == i);
+  }
+  parse_result = hsrequest_parse(&request, &parser, request_1, strlen(request_1) - 4);
+  assert(parse_result == HSPARSE_VALID);
+  assert(request.length == strlen(request_1) - 4);
+  assert(parser.scanned == 0);
+
+  return 0;
+}
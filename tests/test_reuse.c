@@ -0,0 +1,60 @@
+#include "event.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int sv_a[2];
+static int sv_b[2];
+static int sv_c[2];
+static struct hsevent *event_a;
+static struct hsevent *event_b;
+static int reused_called = 0;
+
+static void reused_cb(struct hsevent *event) {
+  (void)event;
+  reused_called++;
+}
+
+/* b is closed and its fd is reused, while the readiness of b is still in this batch */
+static void close_other_cb(struct hsevent *event) {
+  struct hsevent *current = event_a == event ? event_b : event_a;
+  int fd = current->sockfd;
+  hsevent_base_update(EPOLL_CTL_DEL, current, current->event_base);
+  close(fd);
+  hsevent_free(current);
+  assert(dup2(sv_c[0], fd) == fd);
+  struct hsevent *reused = hsevent_init(fd, EPOLLIN | EPOLLET, event->event_base);
+  hsevent_update_cb(reused, HSEVENT_READ, reused_cb);
+  hsevent_update_cb(event, HSEVENT_READ, NULL);
+  hsevent_base_exit(event->event_base);
+}
+
+int main() {
+  struct hsevent_base *base = hsevent_base_init();
+  assert(base);
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv_a) == 0);
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv_b) == 0);
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv_c) == 0);
+  event_a = hsevent_init(sv_a[0], EPOLLIN | EPOLLET, base);
+  event_b = hsevent_init(sv_b[0], EPOLLIN | EPOLLET, base);
+  /* Whichever of them is dispatched first closes the other one */
+  hsevent_update_cb(event_a, HSEVENT_READ, close_other_cb);
+  hsevent_update_cb(event_b, HSEVENT_READ, close_other_cb);
+  assert(write(sv_a[1], "a", 1) == 1);
+  assert(write(sv_b[1], "b", 1) == 1);
+
+  hsevent_base_loop(base);
+  /* The fd of c has nothing to read, only the stale event of b could reach it */
+  assert(reused_called == 0);
+
+  hsevent_base_clear(base);
+  hsevent_base_free(base);
+  close(sv_a[1]);
+  close(sv_b[1]);
+  close(sv_c[0]);
+  close(sv_c[1]);
+  printf("stale events dropped\n");
+  return 0;
+}
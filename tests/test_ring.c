@@ -0,0 +1,67 @@
+#include "buffer.h"
+
+#include <assert.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int main() {
+  struct hsbuffer *buffer = hsbuffer_init_ring(100);
+
+  /* Basic tests */
+  assert(buffer);
+  size_t capacity = hsbuffer_capacity(buffer);
+  assert(capacity >= 100);
+  assert((capacity + 1) % sysconf(_SC_PAGESIZE) == 0);
+  assert(hsbuffer_remain(buffer) == capacity);
+  assert(hsbuffer_readable(buffer) == 0);
+
+  int sv[2];
+  assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+  /* Leave a partial request at the end of the ring */
+  char data[256];
+  for (size_t i = 0; i < sizeof(data); i++) {
+    data[i] = 'a' + i % 26;
+  }
+  size_t first = capacity - 10;
+  for (size_t i = 0; i < first; i += 100) {
+    size_t length = first - i < 100 ? first - i : 100;
+    assert(write(sv[1], data, length) == (ssize_t)length);
+    assert(hsbuffer_recv(sv[0], buffer, length) == (ssize_t)length);
+    hsbuffer_consume(buffer, length - (i + 100 >= first ? 20 : 0));
+  }
+  assert(hsbuffer_readable(buffer) == 20);
+  assert(hsbuffer_remain(buffer) == capacity - 20);
+
+  /* New bytes wrap around, but the readable bytes stay contiguous */
+  assert(write(sv[1], data, 200) == 200);
+  assert(hsbuffer_recv(sv[0], buffer, 200) == 200);
+  assert(hsbuffer_readable(buffer) == 220);
+  assert(hsbuffer_capacity(buffer) == capacity);
+  char *read_pos = hsbuffer_pos(buffer, READ_POS);
+  size_t tail = (first - 20) % 100;
+  assert(!memcmp(read_pos, data + tail, 20));
+  assert(!memcmp(read_pos + 20, data, 200));
+  assert(read_pos[220] == '\0');
+
+  /* Consuming past the end of the first mapping */
+  hsbuffer_consume(buffer, 30);
+  assert(hsbuffer_readable(buffer) == 190);
+  assert(!memcmp(hsbuffer_pos(buffer, READ_POS), data + 10, 190));
+
+  /* Growing keeps the readable bytes */
+  hsbuffer_expand(buffer, capacity * 2);
+  assert(hsbuffer_capacity(buffer) >= capacity * 2);
+  assert(hsbuffer_readable(buffer) == 190);
+  assert(!memcmp(hsbuffer_pos(buffer, READ_POS), data + 10, 190));
+
+  hsbuffer_consume(buffer, 190);
+  assert(hsbuffer_readable(buffer) == 0);
+  assert(hsbuffer_remain(buffer) == hsbuffer_capacity(buffer));
+
+  close(sv[0]);
+  close(sv[1]);
+  hsbuffer_free(buffer);
+  return 0;
+}
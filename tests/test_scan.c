@@ -0,0 +1,73 @@
+#include "scan.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIZE 4096
+
+/**
+ * @brief Compare every kernel with the scalar kernel on the same bytes.
+ */
+static void check(const char *buffer, size_t size) {
+  int flags[3] = { HSSCAN_TOKEN, HSSCAN_VALUE, HSSCAN_URI };
+  for (size_t start = 0; start < 40 && start < size; start++) {
+    hsscan_select(HSSCAN_SCALAR);
+    size_t end = hsscan_headers_end(buffer, size, start);
+    size_t skipped[3];
+    for (int i = 0; i < 3; i++) {
+      skipped[i] = hsscan_skip(buffer, start, size, flags[i]);
+    }
+    for (int level = HSSCAN_SSE42; level <= HSSCAN_AVX2; level++) {
+      if (hsscan_select(level) != level) {
+        continue;
+      }
+      assert(hsscan_headers_end(buffer, size, start) == end);
+      for (int i = 0; i < 3; i++) {
+        assert(hsscan_skip(buffer, start, size, flags[i]) == skipped[i]);
+      }
+    }
+  }
+}
+
+int main() {
+  char buffer[SIZE];
+
+  /* Basic tests */
+  const char *request = "GET / HTTP/1.1\r\nHost: a\r\n\r\n";
+  assert(hsscan_headers_end(request, strlen(request), 0) == strlen(request));
+  assert(hsscan_headers_end(request, strlen(request) - 1, 0) == 0);
+  assert(hsscan_skip(request, 0, strlen(request), HSSCAN_TOKEN) == 3);
+  assert(hsscan_skip(request, 4, strlen(request), HSSCAN_URI) == 5);
+  assert(hsscan_skip(request, 22, strlen(request), HSSCAN_VALUE) == 23);
+
+  /* Long runs of every class, ended by every byte */
+  for (int c = 0; c < 256; c++) {
+    for (size_t length = 0; length < 70; length++) {
+      memset(buffer, 'a', length);
+      buffer[length] = (char)c;
+      memset(buffer + length + 1, 'b', 64);
+      check(buffer, length + 65);
+    }
+  }
+
+  /* The empty line at every offset and split by the end of the buffer */
+  for (size_t offset = 0; offset < 100; offset++) {
+    memset(buffer, 'x', 200);
+    memcpy(buffer + offset, "\r\n\r\n", 4);
+    for (size_t size = offset; size < 200; size++) {
+      check(buffer, size);
+    }
+  }
+
+  /* Random bytes biased to \r and \n */
+  srand(1);
+  for (int round = 0; round < 200; round++) {
+    for (size_t i = 0; i < SIZE; i++) {
+      int r = rand() % 8;
+      buffer[i] = r == 0 ? '\r' : r == 1 ? '\n' : (char)(rand() % 256);
+    }
+    check(buffer, SIZE);
+  }
+  return 0;
+}
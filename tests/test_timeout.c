@@ -0,0 +1,108 @@
+#include "event_handler.h"
+#include "response.h"
+#include "utils.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FILE_SIZE (8 * 1024 * 1024)
+#define STEP      (64 * 1024)
+
+static void make_site(const char *root) {
+  char path[256];
+  snprintf(path, 256, "%s/big.bin", root);
+  mkdir(root, 0755);
+  char *data = (char*)malloc(FILE_SIZE);
+  memset(data, 'd', FILE_SIZE);
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  assert(write(fd, data, FILE_SIZE) == FILE_SIZE);
+  close(fd);
+  free(data);
+}
+
+static void run_server(int listen_sockfd) {
+  struct hsevent_base *base = hsevent_base_init();
+  set_nonblocking(listen_sockfd);
+  struct hsevent *listen_event = hsevent_init(listen_sockfd, EPOLLIN | EPOLLET, base);
+  hsevent_update_cb(listen_event, HSEVENT_READ, accept_conn);
+  hsevent_base_loop(base);
+}
+
+static double elapsed(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main() {
+  /* A download that outlasts the idle timeout is not cut off while the client keeps reading */
+  const char *root = "/tmp/test_timeout_site";
+  make_site(root);
+  strcpy(file_path, root);
+  initial_length = strlen(file_path);
+  idle_timeout = 1;
+  signal(SIGPIPE, SIG_IGN);
+
+  int listen_sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  socklen_t addrlen = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  assert(bind(listen_sockfd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+  assert(listen(listen_sockfd, 16) == 0);
+  assert(getsockname(listen_sockfd, (struct sockaddr*)&addr, &addrlen) == 0);
+
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    run_server(listen_sockfd);
+    exit(0);
+  }
+
+  int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  int rcvbuf = 16 * 1024;
+  setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(int));
+  assert(connect(sockfd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+  const char *request = "GET /big.bin HTTP/1.1\r\nConnection: Keep-Alive\r\n\r\n";
+  assert(write(sockfd, request, strlen(request)) == (ssize_t)strlen(request));
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  char *buf = (char*)malloc(STEP);
+  size_t total = 0;
+  while (1) {
+    ssize_t bytes_read = read(sockfd, buf, STEP);
+    if (bytes_read <= 0) {
+      break;
+    }
+    total += (size_t)bytes_read;
+    usleep(10000);
+  }
+  double seconds = elapsed(&start);
+  printf("%zu bytes in %.1f s\n", total, seconds);
+  assert(seconds > 2 * idle_timeout);  // Otherwise the test did not outlast the timeout
+  /* The headers and the whole file, then the idle connection is closed */
+  assert(total > FILE_SIZE && total < FILE_SIZE + 1024);
+
+  free(buf);
+  close(sockfd);
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+  close(listen_sockfd);
+  char path[256];
+  snprintf(path, 256, "%s/big.bin", root);
+  unlink(path);
+  rmdir(root);
+  return 0;
+}
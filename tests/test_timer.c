@@ -0,0 +1,68 @@
+#include "timer.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+int num_of_expired = 0;
+
+void expire(struct hstimer *timer) {
+  num_of_expired++;
+  timer->data = NULL;
+}
+
+int main() {
+  struct hstimer_wheel wheel;
+  struct hstimer timers[4];
+  uint64_t now = 1000000;
+
+  /* Basic tests */
+  hstimer_wheel_init(&wheel, now);
+  assert(hstimer_wheel_timeout(&wheel, now) == -1);
+  for (int i = 0; i < 4; i++) {
+    hstimer_init(&timers[i], expire, &timers[i]);
+    assert(!hstimer_pending(&timers[i]));
+  }
+
+  /* Timers in level 0 and upper levels */
+  hstimer_add(&wheel, &timers[0], 500);
+  hstimer_add(&wheel, &timers[1], 30 * 1000);
+  hstimer_add(&wheel, &timers[2], 600 * 1000);
+  assert(hstimer_pending(&timers[0]));
+  assert(wheel.num_of_timers == 3);
+  assert(hstimer_wheel_timeout(&wheel, now) == 500);
+
+  hstimer_wheel_advance(&wheel, now + 400);
+  assert(num_of_expired == 0);
+  hstimer_wheel_advance(&wheel, now + 500);
+  assert(num_of_expired == 1);
+  assert(!hstimer_pending(&timers[0]));
+  assert(!timers[0].data);
+
+  hstimer_wheel_advance(&wheel, now + 29900);
+  assert(num_of_expired == 1);
+  hstimer_wheel_advance(&wheel, now + 30000);
+  assert(num_of_expired == 2);
+
+  hstimer_wheel_advance(&wheel, now + 599900);
+  assert(num_of_expired == 2);
+  hstimer_wheel_advance(&wheel, now + 600000);
+  assert(num_of_expired == 3);
+  assert(wheel.num_of_timers == 0);
+  assert(hstimer_wheel_timeout(&wheel, now + 600000) == -1);
+
+  /* Refresh and delete */
+  now += 600000;
+  hstimer_add(&wheel, &timers[3], 1000);
+  hstimer_wheel_advance(&wheel, now + 900);
+  hstimer_add(&wheel, &timers[3], 1000);
+  hstimer_wheel_advance(&wheel, now + 1500);
+  assert(num_of_expired == 3);
+  assert(wheel.num_of_timers == 1);
+  hstimer_del(&wheel, &timers[3]);
+  hstimer_del(&wheel, &timers[3]);
+  assert(wheel.num_of_timers == 0);
+  hstimer_wheel_advance(&wheel, now + 5000);
+  assert(num_of_expired == 3);
+
+  return 0;
+}